@@ -0,0 +1,46 @@
+#ifndef BITMAP_H
+#define BITMAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//  mapa de bits empaquetado: 1 bit por bloque, 0 = libre, 1 = ocupado
+//  se guarda en disco tal cual, en palabras de 64 bits
+class BitMap {
+ public:
+  BitMap();
+  explicit BitMap(size_t bits);
+
+  void resize(size_t bits);
+  bool test(size_t bit) const;
+  void set(size_t bit);
+  void clear(size_t bit);
+
+  //  primer bit libre en [from, bits) o -1; avanza una palabra a la vez
+  long findFirstZero(size_t from = 0) const;
+  //  cantidad de bits libres consecutivos desde from, como maximo limit
+  size_t zeroRunLength(size_t from, size_t limit) const;
+
+  //  indices de las palabras cambiadas desde la ultima llamada, en orden
+  void takeDirtyWords(std::vector<size_t>& out);
+  //  olvidar los cambios pendientes, el contenido ya es igual al de disco
+  void markClean();
+
+  size_t bits() const;
+  size_t bytes() const;
+  uint64_t* data();
+  const uint64_t* data() const;
+
+ private:
+  std::vector<uint64_t> words;
+  std::vector<uint64_t> dirtyWords;  //  1 bit por palabra de words modificada
+  size_t totalBits = 0;
+
+  void markDirty(size_t word);
+
+  //  primera palabra con algun bit libre en [first, words.size()) o -1
+  long findNonFullWord(size_t first) const;
+};
+
+#endif  //  BITMAP_H
@@ -0,0 +1,107 @@
+#ifndef BUFFERCACHE_H
+#define BUFFERCACHE_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "VDisk.h"
+
+//  cache de bloques de tamano fijo delante de otro disco
+//  las lecturas se sirven desde los frames y cargan los bloques que faltan,
+//  las escrituras van directo al disco de abajo (write-through) y actualizan
+//  los frames que ya tengan el bloque, asi el orden de los sync no cambia
+//  el reemplazo es CLOCK: un bloque recien cargado entra sin referencia y
+//  recien un segundo acceso lo protege de la siguiente vuelta de la aguja
+//  se puede usar desde varios hilos: el lock cubre solo los frames y las
+//  lecturas y escrituras al disco de abajo se hacen sin tenerlo
+//  prefetch carga bloques sin esperarlos; una lectura que llega a un bloque
+//  que todavia se esta cargando espera esa lectura en vez de repetirla
+//  con un verificador, cada bloque que llega del disco de abajo se revisa una
+//  vez antes de usarlo; los aciertos no pagan nada
+class BufferCache : public VDisk {
+ public:
+  //  toma posesion de inner
+  BufferCache(VDisk* inner, size_t blockSize, size_t frames);
+  ~BufferCache();
+
+  int read(size_t offset, void* buffer, size_t size);
+  //  lo que esta en los frames se copia y los bloques que faltan de todo el
+  //  lote se piden juntos con un solo readBatch al disco de abajo
+  int readBatch(std::vector<diskRead>& reads);
+  int write(size_t offset, const void* buffer, size_t size);
+  int writeBatch(std::vector<diskWrite>& writes);
+  int sync();
+  //  los frames del rango se descartan antes de pasarle el discard al disco
+  int discard(size_t offset, size_t size);
+  int provision(size_t offset, size_t size);
+  //  los bloques del rango que faltan se piden con readAsync y entran a los
+  //  frames al llegar, sin referencia, asi son los primeros en salir si no se usan
+  void prefetch(size_t offset, size_t size);
+
+  //  verify recibe el numero de bloque y su contenido recien leido y retorna
+  //  false si esta danado; se llama sin el lock de la cache
+  void setVerifier(std::function<bool(size_t block, const char* data)> verify);
+  //  leer del disco de abajo sin pasar por los frames ni verificar, para
+  //  revisar el medio sin llenar la cache
+  int readDirect(size_t offset, void* buffer, size_t size);
+
+  //  dejar el bloque fijo en memoria y retornar su frame, nullptr si no se pudo
+  //  leer o todos los frames estan fijos; cada pin necesita su unpin
+  const char* pin(size_t block);
+  void unpin(size_t block);
+
+  uint64_t hits() const;
+  uint64_t misses() const;
+
+ private:
+  typedef struct frame {
+    size_t block;
+    bool valid;
+    bool referenced;  //  bit de CLOCK
+    int pins;  //  el frame no se reemplaza mientras pins > 0
+  } frame;
+
+  //  bloques seguidos que faltaban en una lectura o en un prefetch
+  typedef struct missingRun {
+    size_t block;  //  primer bloque del tramo
+    std::vector<char> data;  //  los bloques tal como se leen del disco
+    char* out;  //  donde va la parte pedida, nullptr en un prefetch
+    size_t skip;  //  bytes del primer bloque que no se pidieron
+    size_t size;  //  bytes pedidos dentro del tramo
+  } missingRun;
+
+  VDisk* inner;
+  size_t blockSize;
+  std::vector<frame> frames;
+  std::vector<char> data;  //  frames.size() * blockSize bytes
+  std::unordered_map<size_t, size_t> blockToFrame;
+  size_t hand = 0;  //  aguja del CLOCK
+  uint64_t hitCount = 0;
+  uint64_t missCount = 0;
+  //  cuenta las escrituras y discards; un bloque leido sin el lock solo se
+  //  guarda en un frame si nadie escribio mientras tanto
+  uint64_t writeEpoch = 0;
+  std::unordered_set<size_t> prefetching;  //  bloques pedidos por prefetch que no llegaron
+  int prefetchesPending = 0;  //  lotes de prefetch sin terminar
+  std::condition_variable prefetched;  //  avisa cuando termina un lote de prefetch
+  mutable std::mutex lock;  //  frames, blockToFrame, aguja, contadores y prefetch
+  std::function<bool(size_t block, const char* data)> verify;  //  se fija antes de usar la cache
+
+  char* frameData(size_t f);
+  //  frame para un bloque nuevo o -1 si todos estan fijos
+  long evict();
+  //  copiar un bloque leido del disco a un frame, si hay alguno disponible
+  //  y el bloque no entro mientras se leia
+  long install(size_t block, const char* source);
+  //  pasar por verify los bloques completos de un tramo leido; retorna el
+  //  primer bloque danado o -1
+  long firstCorrupt(const missingRun& run);
+  //  actualizar la copia en cache de los bloques que toca una escritura
+  void update(size_t offset, const void* buffer, size_t size);
+};
+
+#endif  //  BUFFERCACHE_H
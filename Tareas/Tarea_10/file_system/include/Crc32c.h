@@ -0,0 +1,21 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <cstddef>
+#include <cstdint>
+
+//  CRC32C (Castagnoli), el de iSCSI y ext4: con la instruccion crc32 de
+//  SSE4.2 si el procesador la tiene, si no con tablas de a 8 bytes por vuelta
+class Crc32c {
+ public:
+  //  crc de size bytes; se encadena pasando el resultado anterior como crc
+  static uint32_t compute(const void* data, size_t size, uint32_t crc = 0);
+  //  true si compute usa la instruccion del procesador
+  static bool hardware();
+
+ private:
+  static uint32_t withInstruction(uint32_t crc, const unsigned char* data, size_t size);
+  static uint32_t withTables(uint32_t crc, const unsigned char* data, size_t size);
+};
+
+#endif  //  CRC32C_H
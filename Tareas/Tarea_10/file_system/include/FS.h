@@ -3,49 +3,279 @@
 
 #include <string>
 #include <fstream>
+#include <istream>
+#include <ostream>
+#include <span>
 #include <vector>
 #include <algorithm>
 #include <cstring>
 #include <cstdint>
 #include <iomanip>
 #include <ctime>
+#include <memory>
+#include <future>
+#include <condition_variable>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include "VDisk.h"
+#include "BufferCache.h"
+#include "ThreadPoolEngine.h"
+#include "BitMap.h"
+#include "NameIndex.h"
+#include "Murmur3.h"
 
-#define DIRECTORY_SIZE 3  // maximo de inodos(archivos) por directorio
-#define TOTAL_BLOCKS 1000  //  numero total de bloques en la diskFile
+#define FS_MAGIC 0x31305346u  //  "FS01" al inicio del superBlock de una imagen formateada
+#define FS_VERSION 8  //  cambia cuando cambia el formato en disco
+#define MOUNT_EMPTY 1  //  mount: la imagen no tiene FS_MAGIC y se puede formatear
+#define TOTAL_BLOCKS 1000  //  numero total de bloques en la diskFile (en cada una si son varias)
 #define BLOCK_SIZE 512  //  inodeSize en bytes de cada bloque
-#define DIRECT_BLOCK_SIZE 4  //  inodeSize bloques directos
-#define INDIRECT_BLOCK_SIZE 2 //  inodeSize de arreglo de bloques indirectos
+#define EXTENT_COUNT 6  //  extents directos (rangos contiguos de bloques) por inode
+#define INDIRECT_BLOCK_SIZE 2  //  [0] bloque indirecto simple, [1] bloque indirecto doble
+#define EXTENTS_PER_BLOCK (BLOCK_SIZE / (int)sizeof(extent))  //  extents en un bloque indirecto
+#define POINTERS_PER_BLOCK (BLOCK_SIZE / (int)sizeof(int))  //  bloques apuntados por el indirecto doble
+#define MAX_EXTENTS (EXTENT_COUNT + EXTENTS_PER_BLOCK + POINTERS_PER_BLOCK * EXTENTS_PER_BLOCK)
+#define INODE_TABLE_NUMBER -1  //  numero con el que se refiere al inode de la tabla de inodos
+#define BLOCK_MAP_CACHE_SIZE 64  //  inodos con su mapa de bloques en memoria
+#define STREAM_CHUNK_SIZE (64 * 1024)  //  bytes que mueven por vez las variantes con streams
+#define READAHEAD_MIN_BLOCKS 4  //  ventana de lectura anticipada al detectar acceso secuencial
+#define READAHEAD_MAX_BLOCKS 64  //  tope de la ventana, bien por debajo de CACHE_BLOCKS
+#define PIN_MAX_BLOCKS 32  //  frames que una lectura sin copias deja fijos a la vez
 #define MAX_NAME_LENGTH 64  //  inodeSize maximo del name
 #define MAX_DATE_LENGTH 20  //  inodeSize maximo de fecha
+#define INLINE_DATA_SIZE 100  //  bytes de un archivo que caben dentro de su inode
+#define COMPRESS_CHUNK_SIZE 4096  //  bytes sin comprimir de cada chunk de un archivo comprimido
+#define INODE_SIZE 256  //  bytes de cada inode en la tabla
+#define INODE_CHUNK_BLOCKS 8  //  bloques del primer tramo de la tabla de inodos
+#define CACHE_BLOCKS 256  //  frames de la cache de bloques
+#define BLOCKS_PER_GROUP 256  //  bloques de cada grupo del asignador, multiplo de 64
+#define INODE_LOCK_STRIPES 64  //  locks de archivo; el inode n usa el n % INODE_LOCK_STRIPES
+#define DIR_MAX_KEYS 5  //  entradas por nodo del arbol B del directorio (2t - 1, t = 3)
+#define JOURNAL_BLOCKS 64  //  bloques del journal para juntar operaciones, ademas del peor caso de una
+#define JOURNAL_MAGIC 0x4C4E524Au  //  "JRNL", marca el encabezado y cada transaccion
+#define RECORD_WRITE 0  //  registro con bytes nuevos para un rango de la imagen
+#define RECORD_REVOKE 1  //  registro que anula las copias anteriores de un bloque liberado
+#define CHECKSUMS_PER_BLOCK (BLOCK_SIZE / 4 - 2)  //  checksums en un bloque de la tabla, sin sus dos campos propios
+#define SCRUB_THREADS 4  //  hilos con los que scrub revisa la imagen
+#define SCRUB_CHUNK_BLOCKS 128  //  bloques que cada hilo de scrub lee por vez
+#define REFCOUNTS_PER_BLOCK (BLOCK_SIZE / 4)  //  cuentas de referencias en un bloque de su tabla
+#define HASHES_PER_BLOCK (BLOCK_SIZE / 16)  //  hashes de 128 bits en un bloque de la tabla de dedup
+#define MAX_SNAPSHOTS 8  //  snapshots que puede haber a la vez, cada uno con un bloque de registro
 
-typedef struct superBlock {
-  int TotalBlocks;  //  numero total de bloques en la diskFile
-  int blockSize;  //  inodeSize en bytes de cada bloque
-  int freeBlocks;  //  bloques disponibles para guardar informacion
-  int maxInodes;  //  maximo de inodos(archivos) en el sistema
-  int usedInodes;  //  inodos en uso
-  int firstFreeBlock;
+//  implementacion del disco sobre la que se monta FS
+enum class DiskBackend {
+  File,  //  pread/pwrite sobre el archivo, pwritev para los lotes de metadatos
+  Mmap,  //  imagen mapeada con mmap: memcpy + msync en los puntos de persistencia
+  Memory  //  sin diskFile.bin: memoria anonima con paginas grandes, se pierde al salir
 };
 
+//  rango contiguo de bloques de un archivo
+typedef struct extent {
+  int start;  //  primer bloque del rango, -1 si el extent no se usa
+  int length;  //  cantidad de bloques contiguos
+} extent;
+
 typedef struct inode{
   char name[MAX_NAME_LENGTH];  //  name del archivo
   char date[MAX_DATE_LENGTH];  //  fecha de creacion
   int inodeSize;  //  inodeSize actual del archivo
   bool active = false;
+  bool compressed = false;  //  contenido en chunks comprimidos (FSCompress.cpp)
+  bool deduped = false;  //  bloques compartidos con los de igual contenido (FSDedup.cpp)
+  int nextFreeInode;  //  siguiente inode de la lista de libres si active == false
 
-  int directBlocks[DIRECT_BLOCK_SIZE];  //  arreglo de bloques directos
-  int indirectBlocks[INDIRECT_BLOCK_SIZE];  //  arreglo de bloques indirectos
-};
+  int extentCount;  //  extents en uso, contando los de los bloques indirectos
+  extent extents[EXTENT_COUNT];  //  primeros extents del archivo, en orden
+  int indirectBlocks[INDIRECT_BLOCK_SIZE];  //  bloques con mas extents, -1 si no hay
+
+  //  un archivo sin extents guarda aqui su contenido; al pasar de
+  //  INLINE_DATA_SIZE bytes se muda a bloques de datos
+  char inlineData[INLINE_DATA_SIZE];
+} inode;
+static_assert(sizeof(inode) == INODE_SIZE, "el inode debe ocupar INODE_SIZE bytes");
+
+typedef struct superBlock {
+  uint32_t magic;  //  FS_MAGIC
+  uint32_t version;  //  FS_VERSION con el que se formateo
+  int TotalBlocks;  //  numero total de bloques en la diskFile
+  int blockSize;  //  inodeSize en bytes de cada bloque
+  int freeBlocks;  //  bloques disponibles para guardar informacion
+  int maxInodes;  //  inodos que caben en la tabla de inodos actual
+  int usedInodes;  //  inodos en uso
+  int firstFreeBlock;  //  todos los bloques anteriores estan ocupados
+  int firstFreeInode;  //  cabeza de la lista de inodos libres, -1 si hay que crecer la tabla
+  int orphanInodes;  //  inodos sin nombre de un add a medias, por nextFreeInode; -1 si no hay
+  int dirRoot;  //  bloque raiz del arbol B del directorio
+  int journalStart;  //  primer bloque del journal
+  int journalBlocks;  //  bloques reservados para el journal
+  int checksumStart;  //  primer bloque de la tabla de checksums
+  int checksumBlocks;  //  bloques de la tabla de checksums
+  int refCountStart;  //  primer bloque de las cuentas de referencias, despues del bitmap
+  int refCountBlocks;
+  int dedupStart;  //  primer bloque de los hashes de dedup, despues de las cuentas
+  int dedupBlocks;
+  int snapshotStart;  //  MAX_SNAPSHOTS bloques de registros de snapshots, despues de los hashes
+  inode inodeTable;  //  la tabla de inodos se guarda como un archivo mas
+} superBlock;
+
+//  registro de un snapshot (FSSnapshot.cpp): el superBlock tal como estaba, con
+//  la tabla de inodos y dirRoot apuntando a copias propias, y donde quedo la
+//  copia del bitmap. Los bloques de datos se comparten con el sistema vivo
+typedef struct snapshotRecord {
+  int active;  //  0 si el registro esta libre
+  char name[MAX_NAME_LENGTH];
+  char date[MAX_DATE_LENGTH];
+  int bitMapStart;  //  copia del bitmap, bitMapBlocks bloques seguidos
+  superBlock sb;
+} snapshotRecord;
+static_assert(sizeof(snapshotRecord) <= BLOCK_SIZE, "un registro de snapshot ocupa un bloque");
+
+//  entrada del directorio: nombre -> numero de inode
+typedef struct dirEntry {
+  char name[MAX_NAME_LENGTH];
+  int inodeNumber;
+} dirEntry;
+
+//  un archivo comprimido que no es inline guarda en sus bloques los chunks
+//  comprimidos uno detras del otro y despues el indice: chunks + 1 offsets de
+//  32 bits, el de cada chunk y el final. Este encabezado va en inlineData
+typedef struct compressedHeader {
+  uint32_t indexOffset;  //  byte de los bloques del archivo donde empieza el indice
+  uint32_t chunks;  //  chunks del archivo, de COMPRESS_CHUNK_SIZE bytes salvo el ultimo
+} compressedHeader;
+static_assert(sizeof(compressedHeader) <= INLINE_DATA_SIZE, "el encabezado va en inlineData");
+
+//  todos los extents de un archivo ya leidos, con el primer bloque logico de cada uno
+typedef struct blockMap {
+  std::vector<extent> extents;
+  std::vector<int> firstLogical;
+} blockMap;
+
+//  bloque de la tabla de checksums: el CRC32C de CHECKSUMS_PER_BLOCK bloques
+//  de la imagen, 0 si el bloque no se revisa (libre, del journal o de la
+//  tabla; un CRC que da 0 se guarda como 0xFFFFFFFF), y al final el CRC32C
+//  de lo anterior, que protege al bloque mismo
+typedef struct checksumBlock {
+  uint32_t entries[CHECKSUMS_PER_BLOCK];
+  //  1 si algun bloque del tramo puede estar reescrito en su lugar sin que su
+  //  checksum nuevo llegara a un commit; se limpia al desmontar sin caidas
+  uint32_t overwritten;
+  uint32_t checksum;
+} checksumBlock;
+static_assert(sizeof(checksumBlock) == BLOCK_SIZE, "un bloque de checksums ocupa un bloque");
+
+//  lectura anticipada de un archivo: mientras las lecturas siguen una detras
+//  de la otra la ventana se duplica y ante un salto vuelve a cero
+typedef struct readAheadWindow {
+  int nextBlock;  //  bloque logico donde empezaria la siguiente lectura secuencial
+  int window;  //  bloques que se piden por delante de la lectura, 0 si no hay
+  int aheadUntil;  //  primer bloque logico que todavia no se pidio
+} readAheadWindow;
+
+//  lectura sin copias: spans de solo lectura, en orden y sin huecos, sobre los
+//  frames de la cache. Lo que no se puede fijar (un archivo inline o comprimido,
+//  o un bloque con la cache llena) se copia a copies y el span apunta ahi
+typedef struct pinnedRead {
+  std::vector<std::span<const char>> spans;
+  std::vector<size_t> pinned;  //  bloques fijos en la cache hasta FS::release
+  std::vector<std::vector<char>> copies;
+} pinnedRead;
+
+//  nodo del arbol B del directorio, ocupa un bloque
+typedef struct dirNode {
+  int leaf;  //  1 si no tiene hijos
+  int count;  //  entradas en uso
+  dirEntry entries[DIR_MAX_KEYS];  //  ordenadas por nombre
+  int children[DIR_MAX_KEYS + 1];  //  bloques de los hijos si leaf == 0
+} dirNode;
+
+//  primer bloque del journal
+typedef struct journalHeader {
+  uint32_t magic;
+  uint32_t unused;
+  uint64_t firstSequence;  //  primera transaccion que todavia puede faltar en su lugar
+} journalHeader;
+
+//  comienzo de una transaccion; lo siguen recordCount registros y despues los datos
+typedef struct transactionHeader {
+  uint32_t magic;
+  uint32_t recordCount;
+  uint64_t sequence;  //  las transacciones de un journal van numeradas sin huecos
+  uint32_t blocks;  //  bloques del journal que ocupa la transaccion completa
+  uint32_t payloadBytes;
+  uint64_t checksum;  //  FNV-1a de registros y datos, descarta transacciones a medias
+} transactionHeader;
+
+typedef struct journalRecord {
+  uint64_t offset;  //  byte de la imagen (RECORD_WRITE) o numero de bloque (RECORD_REVOKE)
+  uint32_t size;  //  bytes de datos que le corresponden
+  uint32_t type;
+} journalRecord;
 
 class FS {
  public:
-  FS();
+  //  monta diskFile.bin si ya tiene un sistema de archivos, si no lo formatea;
+  //  con format la formatea sin mirar lo que tiene
+  FS(DiskBackend backend = DiskBackend::File, bool format = false);
+  //  montar o formatear un disco cualquiera, por ejemplo un StripedDisk sobre
+  //  varias imagenes; al formatear se usa todo su tamano. FS se queda con
+  //  image y lo borra al final
+  FS(VDisk* image, bool format = false);
+  //  montar de solo lectura el snapshot con ese nombre; runtime_error si no existe
+  FS(const std::string& snapshot, DiskBackend backend = DiskBackend::File);
   ~FS();
 
+  //  dejar la imagen vacia: superBlock, bitmap, journal, directorio y tabla de inodos nuevos
+  int format();
+  //  usar el sistema de archivos que ya esta en la imagen; retorna MOUNT_EMPTY
+  //  si no tiene FS_MAGIC y -1 si no se pudo leer o es de otra version. Solo
+  //  lee el superBlock (y rehace el journal); el bitmap y los bloques de la
+  //  tabla de inodos se leen al usarlos
+  int mount();
+
+  //  snapshots (FSSnapshot.cpp): snapshot congela el estado actual copiando
+  //  solo metadatos; los bloques de datos pasan a compartirse y el sistema vivo
+  //  los copia al escribirlos. Las escrituras en curso terminan antes
+  int snapshot(const std::string& name);
+  int deleteSnapshot(const std::string& name);
+  std::vector<std::string> snapshots();
+
   //  crea un inode vacio sin asignarle bloques
   int create(const std::string& name);
-  //  add contenido a un inode vacio
-  int add(const std::string& name, const std::string& data);
+  //  reemplazar todo el contenido del archivo; con compress se guarda en chunks
+  //  comprimidos y con dedup sus bloques se comparten con los de igual
+  //  contenido. Los write y append siguientes lo mantienen asi. Si falla
+  //  queda el contenido anterior, salvo que no hubiera lugar para los dos a
+  //  la vez: entonces se reescribe en su lugar y un fallo lo deja vacio
+  int add(const std::string& name, const std::string& data, bool compress = false, bool dedup = false);
+  //  crear target con el mismo contenido que source compartiendo sus bloques;
+  //  un bloque se copia recien cuando uno de los dos lo escribe
+  int clone(const std::string& source, const std::string& target);
+  //  leer hasta buffer.size() bytes desde offset; retorna los bytes leidos o -1
+  long read(const std::string& name, size_t offset, std::span<char> buffer);
+  //  escribir data en offset, creciendo el archivo si hace falta; retorna los bytes escritos o -1
+  long write(const std::string& name, size_t offset, std::span<const char> data);
+  //  escribir data al final del archivo
+  long append(const std::string& name, std::span<const char> data);
+  //  copiar hasta size bytes desde offset hacia out, directo desde la cache
+  long read(const std::string& name, size_t offset, size_t size, std::ostream& out);
+  //  escribir en offset todo lo que quede en in, de a STREAM_CHUNK_SIZE bytes
+  long write(const std::string& name, size_t offset, std::istream& in);
+  long append(const std::string& name, std::istream& in);
+  //  leer sin copiar: out recibe spans sobre los frames de la cache, que quedan
+  //  fijos hasta release(out). Retorna los bytes cubiertos, 0 al final o -1; para
+  //  no llenar la cache cubre a lo sumo PIN_MAX_BLOCKS bloques, asi que una
+  //  lectura grande se hace de a tramos. Escribir el archivo en su lugar antes
+  //  del release se ve en los spans; borrarlo, achicarlo o moverle bloques no,
+  //  porque un bloque fijo no pasa a otro dueno hasta el release
+  long readPinned(const std::string& name, size_t offset, size_t size, pinnedRead& out);
+  void release(pinnedRead& read);
+  //  read y write sin esperar: corren en los hilos de FS::workers y el
+  //  resultado llega por el future; buffer/data tienen que seguir vivos hasta
+  //  entonces
+  std::future<long> readAsync(const std::string& name, size_t offset, std::span<char> buffer);
+  std::future<long> writeAsync(const std::string& name, size_t offset, std::span<const char> data);
   //  Deletes a file
   int deleteFile(const std::string& fileName);
   //  imprimir los metadatos de un inode
@@ -56,32 +286,341 @@ class FS {
   int printInodeContent(std::string name);
 
   int changeName(std::string name,std::string newName);
+  //  cada operacion que cambia algo retorna recien cuando su transaccion es
+  //  durable; las que terminan mientras otro commit espera su sync van juntas
+  //  en el siguiente. sync confirma ya la transaccion en curso
+  int sync();
+  //  revisar el checksum de todos los bloques de la imagen con SCRUB_THREADS
+  //  hilos, leyendo del disco y no de la cache; el sistema de archivos queda
+  //  quieto mientras tanto. Retorna cuantos bloques estan danados o -1
+  int scrub();
+  //  lecturas de bloques servidas desde la cache y las que tuvieron que ir al disco
+  uint64_t cacheHits() const;
+  uint64_t cacheMisses() const;
 
 
   //
   void fileList();
 
  private:
-  std::fstream diskFile;  //  archivo que simula la diskFile de almacenamiento
+  friend struct FSTest;  //  tests/FSTest.cpp revisa el estado interno
+
+  BufferCache* disk;  //  cache de bloques delante del disco que guarda diskFile.bin
+  //  hilos fijos para readAsync y writeAsync, creados con el primero: los
+  //  locks de FS no pasan de un hilo a otro, asi que la operacion entera corre
+  //  en uno de ellos. No es el IOEngine del disco, asi una operacion que espera
+  //  su E/S nunca ocupa el hilo que la haria
+  ThreadPoolEngine* workers = nullptr;
+  std::once_flag workersOnce;
+  //  poner operation en workers, que se crean aqui la primera vez
+  std::future<long> runAsync(std::function<long()> operation);
   superBlock sb;  //  superBlock del sistema de archivos
-  std::vector<inode> inodesTable;  //  tabla de archivos (inodos)
-  int sizeTablaBytes;  //  inodeSize en bytes de inodesTable
-  int tableBlocks;  //  cuantos bloques usa la tabla de inodos
+  std::vector<std::vector<inode>> inodesTable;  //  tabla de inodos por bloque, vacio si no se ha leido
+  int inodesPerBlock;  //  inodos por bloque de la tabla, no se parten entre bloques
   int bitMapBlocks;
   int sizeBitMapBytes;
   int superBlockBlocks;
-  std::vector<int> bitMap;  //  mapa de bits para gestionar bloques
+  int bitMapStart;  //  primer bloque del bitmap
+  BitMap bitMap;  //  mapa de bits para gestionar bloques, 1 bit por bloque
+  bool bitMapLoaded = false;  //  false hasta la primera vez que se asigna o libera un bloque
+  std::vector<int> groupFree;  //  bloques libres de cada grupo, se arma al cargar el bitmap
+  NameIndex nameIndex;  //  cache nombre -> numero de inode de los archivos ya buscados
+  std::unordered_map<int, std::shared_ptr<blockMap>> blockMaps;  //  cache de mapas de bloques por inode
+  std::unordered_map<int, readAheadWindow> readAheads;  //  lectura anticipada de cada archivo leido
+  bool readOnly = false;  //  montado desde un snapshot
+
+  //  concurrencia: dirLock cubre los nombres (compartido para buscar, exclusivo
+  //  para crear, borrar o renombrar), inodeLocks el contenido de cada archivo
+  //  (compartido para leer, exclusivo para escribir) y metaLock todo el estado
+  //  de arriba y de abajo. Se toman en ese orden y nunca dos inodeLocks a la vez.
+  //  Salvo que se diga otra cosa los metodos privados se llaman con metaLock
+  std::shared_mutex dirLock;
+  std::shared_mutex inodeLocks[INODE_LOCK_STRIPES];
+  std::mutex metaLock;
+
+  //  estado sucio hasta el proximo saveChanges
+  superBlock savedSb;  //  superBlock tal como quedo en disco
+  std::unordered_set<int> dirtyInodeBlocks;  //  bloques logicos de la tabla con inodos cambiados
+  std::unordered_map<int, std::vector<char>> dirtyMeta;  //  imagen de bloques de directorio e indirectos
+
+  //  journal de rehacer (FSJournal.cpp)
+  uint64_t journalSequence = 1;  //  numero de la proxima transaccion
+  int journalHead = 0;  //  proximo bloque libre del journal, 0 si hay que reiniciarlo
+  bool blocksFreed = false;  //  la transaccion en curso libera bloques
+  std::unordered_set<int> journaledBlocks;  //  bloques de metadatos con copia en el journal
+  std::vector<int> revokedBlocks;  //  de esos, los liberados en la transaccion en curso
+  std::vector<int> pendingDiscards;  //  bloques liberados que el host puede recuperar tras el commit
+  //  lecturas sin copias (FSPinned.cpp), con metaLock: pinCounts cuenta las
+  //  lecturas abiertas sobre cada bloque. Uno que se libera mientras esta fijo
+  //  pasa a pinHolder, un huerfano que mount libera si el sistema se cae, y
+  //  queda en pinnedFreed hasta su ultimo release; pinHolder se libera cuando
+  //  pinnedFreed se vacia. Si no entra en pinHolder queda en unheldBlocks y se
+  //  libera directo con su ultimo release
+  std::unordered_map<int, int> pinCounts;
+  std::unordered_set<int> pinnedFreed;
+  std::unordered_set<int> unheldBlocks;
+  int pinHolder = -1;
+  //  asignados desde el ultimo commit y libres en el: la imagen durable no los
+  //  usa, asi que una transaccion grande los escribe en su lugar antes del journal
+  std::unordered_set<int> freshBlocks;
+  std::unordered_set<int> releasedBlocks;  //  liberados desde el ultimo commit, no son frescos al reusarlos
+  //  group commit: un commit arma la transaccion con metaLock y la escribe sin
+  //  el, salvo que libere bloques. commitLock va despues de metaLock y ordena
+  //  los commits; committingMeta es la imagen de dirtyMeta que se esta
+  //  escribiendo, y readMeta/writeMeta la ven hasta el commit siguiente
+  std::mutex commitLock;
+  std::unordered_map<int, std::vector<char>> committingMeta;
+  bool journalFailed = false;  //  con commitLock: la ultima escritura del journal fallo, hay que reiniciarlo
+  uint64_t openTransaction = 1;  //  numero de la transaccion en curso; no se reinicia al formatear
+  //  con durableLock: hasta que transaccion todo es durable y si hay un hilo
+  //  haciendo el commit por los que esperan
+  std::mutex durableLock;
+  std::condition_variable durableChanged;
+  uint64_t durableSequence = 0;
+  bool leading = false;
+
+  //  se declara primero en cada operacion publica que cambia algo: al salir,
+  //  ya sin los locks de la operacion, espera que su transaccion sea durable
+  class durableScope {
+   public:
+    explicit durableScope(FS* fs);
+    ~durableScope();
+
+   private:
+    FS* fs;
+    uint64_t outer;  //  transaccion de la operacion que contiene a esta
+  };
+
+  //  checksums por bloque (FSChecksum.cpp): los de datos cambian al escribirlos
+  //  y los de metadatos en cada commit, que tambien lleva al journal los
+  //  bloques de la tabla que cambiaron. checksumLock va despues de metaLock y
+  //  tambien se toma sin el, desde writeDisk y al verificar lecturas
+  std::mutex checksumLock;
+  std::vector<uint32_t> checksums;  //  toda la tabla en memoria, vacia hasta montar o formatear
+  std::vector<uint32_t> overwritten;  //  campo overwritten de cada bloque de la tabla
+  //  transaccion que lleva la marca de cada tramo: se puede reescribir en su
+  //  lugar cuando durableSequence llega a ella
+  std::vector<uint64_t> markTickets;
+  //  liberados desde el ultimo commit: en disco todavia tienen checksum, y
+  //  reusarlos antes del commit tambien los reescribe en su lugar
+  std::unordered_set<int> freedChecksums;
+  std::unordered_set<int> dirtyChecksumBlocks;  //  bloques de la tabla a escribir en el proximo commit
+  int checksumTableStart = 0;  //  copia de sb.checksumStart para leerla sin metaLock
+
+  //  bloques compartidos (FSDedup.cpp): refCounts cuenta los duenos de cada
+  //  bloque ademas del primero, asi un bloque comun tiene 0 y el bit del bitmap
+  //  sigue diciendo si esta ocupado. blockHashes guarda el hash de los bloques
+  //  de archivos con dedup y dedupIndex es su inversa; los tres se cargan con
+  //  el bitmap y sus cambios van al journal como cualquier metadato
+  std::vector<uint32_t> refCounts;
+  std::vector<hash128> blockHashes;
+  std::unordered_map<hash128, int, hash128Hasher> dedupIndex;
+
+  //  leer las cuentas y los hashes y armar dedupIndex
+  void loadSharing();
+  //  un dueno mas para el bloque
+  void shareBlock(int block);
+  //  si el bloque tiene otros duenos se le saca uno y retorna true
+  bool unshareBlock(int block);
+  void rememberHash(int block, const hash128& hash);
+  //  el bloque se libero: su hash deja de apuntarlo
+  void forgetHash(int block);
+  //  escribir un archivo con dedup: cada bloque tocado se arma entero y pasa a
+  //  ser uno igual que ya exista o uno nuevo; nunca se escribe en su lugar.
+  //  Con el lock del archivo exclusivo y sin metaLock
+  long writeDeduped(int index, size_t offset, const char* data, size_t size);
+  //  antes de escribir en su lugar el rango: cada bloque compartido (FSClone.cpp)
+  //  o de unmarked pasa a un bloque propio, copiando lo que tenia si la
+  //  escritura no lo cubre entero. Con metaLock en meta, que se suelta
+  //  mientras copia; el mapa del archivo cambia
+  int breakSharing(int index, size_t offset, size_t size, std::unique_lock<std::mutex>& meta,
+                   const std::unordered_set<int>& unmarked);
+
+  //  tabla de checksums vacia para format, marcada para escribirse entera
+  void resetChecksums();
+  //  leer la tabla de checksums al montar; un bloque de la tabla danado
+  //  deja sus bloques sin revisar
+  int loadChecksums();
+  //  el bloque leido coincide con su checksum; sin metaLock
+  bool verifyBlock(size_t block, const char* data);
+  //  guardar checksums de bloques recien escritos; sin metaLock
+  void updateChecksums(const std::vector<std::pair<int, uint32_t>>& sums);
+  //  el bloque liberado deja de revisarse
+  void forgetChecksum(int block);
+  //  antes de reescribir en su lugar bloques que ya tienen checksum, marcar
+  //  sus tramos en la transaccion en curso; los bloques cuya marca todavia no
+  //  es durable quedan en unmarked para moverlos con breakSharing. Sin lugar
+  //  para moverlos hace un commit y unmarked queda vacio. Con metaLock
+  int markOverwrites(const blockMap& map, size_t offset, size_t size, std::unordered_set<int>& unmarked);
+  //  al montar despues de una caida: los checksums de los tramos marcados se
+  //  rehacen con lo que quedo en disco
+  int settleChecksums();
+  //  desmontar sin caida: el proximo commit deja todos los tramos sin marca
+  void clearOverwrites();
+  //  checksums de los bloques enteros de writes y, al final de writes, los
+  //  bloques de la tabla que cambiaron, armados en images
+  void checksumWrites(std::vector<diskWrite>& writes, std::vector<checksumBlock>& images);
 
   //  buscar un inode y retornar su indice o -1 si no existe
   int searchInode(const std::string& name);
-  //  buscar los bloques libres necesarios en el bitmap y retornar un arreglo con sus direcciones 
-  std::vector<int> findFreeBlock(int cantidad);
-  //  escribir contenido en la diskFile
-  int writeDisk(inode& node, const std::string& data, int blocksNeeded, std::vector<int>& blocks);
-  //  actualizar la diskFile
+  //  searchInode y el inodeSize del archivo tomando metaLock
+  int lookup(const std::string& name);
+  size_t sizeOf(int index);
+  std::shared_mutex& inodeLock(int number);
+  //  cuerpo de read y write con streams, con el lock del archivo ya tomado y sin metaLock
+  long readTo(int index, size_t offset, size_t size, std::ostream& out);
+  //  cuerpo de readPinned: size ya esta dentro del archivo
+  long pinRange(int index, size_t offset, size_t size, pinnedRead& out);
+  //  soltar los frames sin tocar pinCounts: solo para quien los fijo y los
+  //  suelta sin dejar el lock del archivo, como readTo
+  void unpinAll(pinnedRead& read);
+  //  releaseBlock de un bloque fijo: se lo queda pinHolder y retorna true; con
+  //  metaLock
+  bool deferRelease(int block);
+  long writeFrom(int index, size_t offset, std::istream& in);
+  //  olvidar todo lo que se tenga en memoria de la imagen anterior
+  void resetState();
+  //  abrir el disco del backend con la cache delante
+  void openDisk(DiskBackend backend);
+  void openDisk(VDisk* image);
+  //  con un snapshot montado nada se escribe: avisa y retorna true
+  bool refuseWrite();
+  int mountSnapshot(const std::string& name);
+  //  slot del registro con ese nombre o -1
+  int findSnapshot(const std::string& name, snapshotRecord& record);
+  //  posiciones derivadas del superBlock: bitmap e inodos por bloque
+  void computeLayout();
+  //  leer el bitmap de disco si todavia no se leyo
+  void loadBitMap();
+  //  contar los libres de cada grupo desde el bitmap
+  void countGroupFree();
+  //  leer de disco el bloque b de la tabla de inodos
+  void loadInodeBlock(int b);
+  //  tomar un inode de la lista de libres, creciendo la tabla si hace falta; -1 si no hay espacio
+  int allocateInode();
+  //  agregar un tramo nuevo a la tabla de inodos; retorna 0 o -1
+  int growInodeTable();
+
+  //  mapa de bloques de los archivos (FSBlockMap.cpp)
+  //  inode con ese numero, leyendo su bloque de la tabla si hace falta;
+  //  INODE_TABLE_NUMBER es el inode de la tabla de inodos
+  inode& inodeAt(int number);
+  //  dejar un inode sin extents ni bloques indirectos
+  void resetExtents(inode& node);
+  //  agregar un extent al final del archivo, uniendolo al ultimo si quedan contiguos
+  int appendExtent(int number, const extent& e);
+  //  extents del archivo desde la cache, leyendo los bloques indirectos solo si no estaba
+  std::shared_ptr<const blockMap> getBlockMap(int number);
+  //  bloque fisico que guarda el bloque logico indicado del archivo o -1
+  int mapBlock(int number, int logicalBlock);
+  //  cambiar el bloque fisico de un bloque logico que el archivo ya tiene, o
+  //  agregarlo al final, partiendo el extent que lo contiene
+  int remapBlock(int number, int logicalBlock, int physical);
+  //  desde el bloque logico first el archivo pasa a tener solo tail; sus
+  //  bloques anteriores desde first, incluidos los que quedan despues del
+  //  final nuevo, se liberan
+  int replaceTail(int number, int first, const std::vector<extent>& tail);
+  //  reemplazar los extents del archivo; los slots antes de from no cambiaron
+  int setExtents(int number, const std::vector<extent>& extents, int from);
+  //  leer todos los extents del inode, directos e indirectos
+  int loadExtents(const inode& node, std::vector<extent>& extents);
+  //  leer el extent numero slot del inode, sea directo o indirecto
+  int readExtentSlot(const inode& node, int slot, extent& e);
+  //  escribir el extent numero slot donde le corresponda, creando bloques indirectos
+  int writeExtentSlot(inode& node, int slot, const extent& e);
+  //  bloque indirecto nuevo con todas sus entradas en -1
+  int allocateIndexBlock();
+
+  //  arbol B del directorio (FSDirectory.cpp), cada nodo se lee y escribe como un bloque
+  int dirLookup(const std::string& name);
+  int dirInsert(const std::string& name, int inodeNumber);
+  int dirRemove(const std::string& name);
+  //  recorrer las entradas en orden alfabetico
+  void dirForEach(int block, void (*visit)(void* context, const dirEntry& entry), void* context);
+  //  todos los bloques del arbol que cuelga de root, cada padre antes que sus hijos
+  std::vector<int> dirNodeBlocks(int root);
+  int readDirNode(int block, dirNode& node);
+  int writeDirNode(int block, const dirNode& node);
+  int allocateDirNode();
+  int dirSplitChild(dirNode& parent, int parentBlock, int index);
+  int dirInsertNonFull(int block, const dirEntry& entry);
+  int dirRemoveFrom(int block, const std::string& name);
+  //  dejar al hijo index con al menos DIR_T entradas antes de bajar a borrar
+  void dirFill(dirNode& parent, int parentBlock, int index);
+  void dirMerge(dirNode& parent, int parentBlock, int index);
+  //  nombre del inode en la posicion index, usado por nameIndex para comparar
+  static const char* inodeName(const void* fs, int index);
+  //  buscar los bloques libres necesarios en el bitmap y retornarlos como la menor
+  //  cantidad posible de extents, como maximo maxExtents; la busqueda empieza en
+  //  goal y sigue por los grupos siguientes, sin goal empieza en firstFreeBlock
+  std::vector<extent> findFreeBlock(int cantidad, int maxExtents, int goal = -1);
+  //  marcar como ocupados los bloques de un extent
+  void claimExtent(const extent& e);
+  //  agregar bloques al final del archivo, alargando su ultimo extent si lo que sigue esta libre
+  int growFile(int number, int blocks);
+  //  escribir size bytes del archivo desde offset (data nullptr escribe ceros)
+  //  en un lote de bloques enteros, completando los bordes con lo que ya tenian,
+  //  y guardar sus checksums; el archivo ya debe tener los bloques. Solo usa
+  //  map, asi que no necesita metaLock
+  int writeDisk(const blockMap& map, size_t offset, const char* data, size_t size);
+  //  leer size bytes del contenido del archivo desde offset, venga de
+  //  inlineData, de chunks comprimidos o de sus bloques; sin metaLock
+  int readDisk(int number, size_t offset, char* data, size_t size);
+  //  leer size bytes de los bloques del archivo desde offset, un lote con una
+  //  lectura por extent tocado, y pedir por adelantado lo que sigue si la
+  //  lectura es secuencial; sin metaLock, lo toma solo para buscar el mapa
+  int readStream(int number, size_t offset, char* data, size_t size);
+  //  archivos comprimidos (FSCompress.cpp), sin metaLock: leer descomprimiendo
+  //  solo los chunks que tocan el rango, y escribir comprimiendo de nuevo desde
+  //  el chunk donde empieza el cambio; los anteriores quedan como estaban
+  int readCompressed(int number, size_t offset, char* data, size_t size);
+  long writeCompressed(int index, size_t offset, const char* data, size_t size);
+  //  actualizar la lectura anticipada del archivo con una lectura de
+  //  [offset, offset + size) y retornar los rangos fisicos a pedir
+  std::vector<extent> readAhead(int number, size_t offset, size_t size, const blockMap& map);
+  //  el contenido del archivo esta en inlineData y no en bloques
+  static bool isInline(const inode& node);
+  //  escribir en el archivo creciendo lo necesario y actualizar su inodeSize;
+  //  con el lock del archivo exclusivo y sin metaLock
+  long writeAt(int index, size_t offset, const char* data, size_t size);
+  //  cerrar una operacion: sus cambios quedan en la transaccion en curso, que
+  //  durableScope espera; se confirma ya si libera bloques o el journal se llenaria
   void saveChanges();
-  //  free data blocks
-  int freeDataBlocks(const inode& node);
+  //  escribir la transaccion en el journal con un solo sync y despues en su
+  //  lugar: superBlock, bloques del bitmap e inodos sucios y dirtyMeta. Con
+  //  meta suelta metaLock mientras escribe, si la transaccion no libera bloques
+  int commit(std::unique_lock<std::mutex>* meta = nullptr);
+  //  hacer el commit que cubre la transaccion ticket, o esperar al que la
+  //  esta haciendo; sin metaLock
+  void waitDurable(uint64_t ticket);
+  //  bloques del journal para el formato actual: JOURNAL_BLOCKS mas la peor
+  //  transaccion de una sola operacion sin contar sus bloques frescos
+  int journalSize();
+  //  hacer durable lo escrito en su lugar y empezar el journal de nuevo;
+  //  espera al commit que este escribiendo
+  int checkpoint();
+  //  rehacer las transacciones completas del journal; retorna cuantas o -1
+  int replayJournal();
+  //  el inode cambio y su bloque de la tabla se escribe en el proximo saveChanges
+  void markInodeDirty(int number);
+  //  leer/escribir parte de un bloque de metadatos; las escrituras quedan en
+  //  dirtyMeta y las lecturas ven esa copia hasta que se guarda
+  int readMeta(int block, size_t offset, void* buffer, size_t size);
+  int writeMeta(int block, size_t offset, const void* buffer, size_t size);
+  //  liberar los bloques de datos y los bloques indirectos del archivo
+  int freeDataBlocks(int number);
+  //  inode sin nombre para el contenido nuevo de un add, en la lista de
+  //  huerfanos hasta releaseOrphan; -1 si no hay inodos
+  int allocateOrphan(bool compress, bool dedup);
+  //  liberar los bloques de un huerfano y devolverlo a la lista de libres
+  void releaseOrphan(int number);
+  //  liberar solo los bloques indirectos de un inode
+  void releaseIndirectBlocks(const inode& node);
+  //  marcar un bloque como libre en el bitmap y el superBlock
+  void releaseBlock(int block);
+  //  devolver al host el espacio de los bloques liberados que siguen libres,
+  //  un discard por rango contiguo; solo despues de que la liberacion es durable
+  void discardFreedBlocks();
   std::string getActualDate();
 
 };
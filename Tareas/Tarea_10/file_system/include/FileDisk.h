@@ -0,0 +1,34 @@
+#ifndef FILEDISK_H
+#define FILEDISK_H
+
+#include "VDisk.h"
+#include "IOEngine.h"
+
+//  disco respaldado por un archivo accedido con pread/pwrite sobre un descriptor
+//  cada acceso es una llamada posicional, sin estado de posicion compartido;
+//  los lotes se entregan completos al IOEngine y se esperan juntos
+class FileDisk : public VDisk {
+ public:
+  FileDisk(const std::string& path, size_t size);
+  ~FileDisk();
+
+  int read(size_t offset, void* buffer, size_t size);
+  int write(size_t offset, const void* buffer, size_t size);
+  int writeBatch(std::vector<diskWrite>& writes);
+  int readBatch(std::vector<diskRead>& reads);
+  void readAsync(std::vector<diskRead> reads, std::function<void(int)> done);
+  void writeAsync(std::vector<diskWrite> writes, std::function<void(int)> done);
+  int sync();
+  //  fdatasync tambien por el IOEngine
+  void syncAsync(std::function<void(int)> done);
+  //  FALLOC_FL_PUNCH_HOLE: el host libera los bloques y el tamano no cambia
+  int discard(size_t offset, size_t size);
+  //  fallocate comun sobre el rango
+  int provision(size_t offset, size_t size);
+
+ private:
+  int fd = -1;  //  descriptor del archivo que simula el disco de almacenamiento
+  IOEngine* engine = nullptr;  //  io_uring o el pool de hilos que lo reemplaza
+};
+
+#endif  //  FILEDISK_H
@@ -0,0 +1,50 @@
+#ifndef IOENGINE_H
+#define IOENGINE_H
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+#define IO_QUEUE_DEPTH 64  //  operaciones en vuelo como maximo en el anillo de io_uring
+#define IO_POOL_THREADS 4  //  hilos del motor de reemplazo cuando no hay io_uring
+
+//  una operacion de un lote: size bytes entre buffer y offset del descriptor
+typedef struct ioRequest {
+  int fd;
+  size_t offset;
+  void* buffer;
+  size_t size;
+  bool write;
+  bool sync;  //  fdatasync del descriptor; offset, buffer y size no se usan
+} ioRequest;
+
+//  motor de E/S asincrona: todas las operaciones de un lote se entregan juntas
+//  y done se llama una sola vez, desde otro hilo, cuando terminaron todas
+class IOEngine {
+ public:
+  virtual ~IOEngine();
+
+  //  el lote se copia, pero sus buffers tienen que vivir hasta que se llame done;
+  //  done recibe 0 o -1 si alguna operacion fallo
+  virtual void submit(const std::vector<ioRequest>& batch, std::function<void(int)> done) = 0;
+  //  entregar el lote y esperar a que termine; retorna 0 o -1
+  int run(const std::vector<ioRequest>& batch);
+
+  //  io_uring si el kernel lo permite, si no un pool de hilos con pread/pwrite
+  static IOEngine* create();
+
+ protected:
+  //  lote en curso: se libera con la ultima operacion
+  typedef struct batchState {
+    std::atomic<size_t> pending;
+    std::atomic<bool> failed;
+    std::function<void(int)> done;
+  } batchState;
+
+  static batchState* startBatch(size_t operations, std::function<void(int)> done);
+  //  una operacion del lote termino, bien o mal
+  static void complete(batchState* state, bool ok);
+};
+
+#endif  //  IOENGINE_H
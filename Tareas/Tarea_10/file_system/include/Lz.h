@@ -0,0 +1,20 @@
+#ifndef LZ_H
+#define LZ_H
+
+#include <cstddef>
+
+//  compresor de la familia LZ77 con el formato de bloque de LZ4: secuencias de
+//  literales seguidas de una copia (distancia de 16 bits, largo minimo 4). Busca
+//  con una tabla hash de una sola entrada, asi que es rapido y no necesita
+//  memoria mas alla de la tabla
+class Lz {
+ public:
+  //  comprimir size bytes en dest; retorna los bytes escritos o -1 si no
+  //  entran en capacity
+  static long compress(const char* source, size_t size, char* dest, size_t capacity);
+  //  descomprimir size bytes en dest; retorna los bytes producidos o -1 si
+  //  los datos no son validos o no entran en capacity
+  static long decompress(const char* source, size_t size, char* dest, size_t capacity);
+};
+
+#endif  //  LZ_H
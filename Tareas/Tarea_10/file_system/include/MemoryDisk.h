@@ -0,0 +1,35 @@
+#ifndef MEMORYDISK_H
+#define MEMORYDISK_H
+
+#include "VDisk.h"
+
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)  //  pagina grande de x86-64 y arm64
+
+//  disco solo en memoria, sin archivo detras: una region anonima mapeada con
+//  paginas grandes (MAP_HUGETLB) si el host tiene reservadas, si no con paginas
+//  comunes que el kernel puede juntar (MADV_HUGEPAGE). read/write son memcpy y
+//  sync no hace nada; todo se pierde al destruirlo. Sirve de capa de cache
+//  caliente y para medir FS sin el ruido del disco
+class MemoryDisk : public VDisk {
+ public:
+  MemoryDisk(size_t size);
+  ~MemoryDisk();
+
+  int read(size_t offset, void* buffer, size_t size);
+  int write(size_t offset, const void* buffer, size_t size);
+  int sync();
+  //  MADV_DONTNEED de las paginas enteras del rango: vuelven a leerse como ceros
+  int discard(size_t offset, size_t size);
+  //  MADV_POPULATE_WRITE: las paginas del rango quedan asignadas y sin fallos despues
+  int provision(size_t offset, size_t size);
+  //  true si la region quedo sobre paginas grandes reservadas
+  bool hugePages() const;
+
+ private:
+  char* base = nullptr;  //  inicio de la region
+  size_t mapped = 0;  //  bytes mapeados, diskSize redondeado a pagina grande
+  size_t pageSize = 0;  //  pagina de la region, para alinear los madvise
+  bool huge = false;
+};
+
+#endif  //  MEMORYDISK_H
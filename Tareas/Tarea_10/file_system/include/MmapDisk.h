@@ -0,0 +1,33 @@
+#ifndef MMAPDISK_H
+#define MMAPDISK_H
+
+#include <mutex>
+#include "VDisk.h"
+
+//  disco respaldado por un archivo mapeado completo en memoria con mmap
+//  read/write son memcpy sobre las paginas mapeadas, sync hace msync
+//  solo del rango que se ensucio desde el ultimo sync
+class MmapDisk : public VDisk {
+ public:
+  MmapDisk(const std::string& path, size_t size);
+  ~MmapDisk();
+
+  int read(size_t offset, void* buffer, size_t size);
+  int write(size_t offset, const void* buffer, size_t size);
+  int sync();
+  //  FALLOC_FL_PUNCH_HOLE: el host libera los bloques y el tamano no cambia
+  int discard(size_t offset, size_t size);
+  //  fallocate comun sobre el rango
+  int provision(size_t offset, size_t size);
+
+ private:
+  int fd = -1;  //  descriptor del archivo de imagen
+  char* base = nullptr;  //  inicio del mapeo
+  //  rango [dirtyBegin, dirtyEnd) escrito sin msync; write y sync llegan
+  //  desde varios hilos, asi que se toca solo con dirtyLock
+  std::mutex dirtyLock;
+  size_t dirtyBegin;
+  size_t dirtyEnd;
+};
+
+#endif  //  MMAPDISK_H
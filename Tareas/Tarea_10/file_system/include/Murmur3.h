@@ -0,0 +1,32 @@
+#ifndef MURMUR3_H
+#define MURMUR3_H
+
+#include <cstddef>
+#include <cstdint>
+
+//  hash de 128 bits; dos bloques con el mismo hash se tratan como candidatos
+//  a ser iguales, nunca como iguales sin comparar
+typedef struct hash128 {
+  uint64_t low;
+  uint64_t high;
+} hash128;
+
+inline bool operator==(const hash128& a, const hash128& b) {
+  return a.low == b.low && a.high == b.high;
+}
+
+//  para usar hash128 como clave de unordered_map: sus bits ya estan mezclados
+typedef struct hash128Hasher {
+  size_t operator()(const hash128& h) const {
+    return h.low;
+  }
+} hash128Hasher;
+
+//  MurmurHash3 x64_128: no es criptografico, pero procesa 16 bytes por vuelta
+//  con multiplicaciones y rotaciones y reparte bien contenidos parecidos
+class Murmur3 {
+ public:
+  static hash128 compute(const void* data, size_t size, uint32_t seed = 0);
+};
+
+#endif  //  MURMUR3_H
@@ -0,0 +1,49 @@
+#ifndef NAMEINDEX_H
+#define NAMEINDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+//  indice hash de direccionamiento abierto (sondeo lineal) de nombre -> numero de inode
+//  las ranuras solo guardan el hash y el numero de inode; el nombre se compara contra
+//  el que devuelve keyOf, asi que buscar no copia ni reserva memoria
+class NameIndex {
+ public:
+  //  retorna el nombre guardado para el valor (numero de inode) indicado
+  typedef const char* (*KeyFunction)(const void* owner, int value);
+
+  NameIndex(KeyFunction keyOf, const void* owner);
+
+  void clear();
+  //  numero de inode con ese nombre o -1
+  int find(std::string_view name) const;
+  //  asume que el nombre no esta en el indice
+  void insert(std::string_view name, int value);
+  //  retorna el valor eliminado o -1 si no estaba
+  int erase(std::string_view name);
+  size_t size() const;
+
+ private:
+  static const int EMPTY = -1;
+  static const int DELETED = -2;
+
+  typedef struct slot {
+    uint32_t hash;
+    int value;  //  EMPTY, DELETED o un numero de inode
+  } slot;
+
+  std::vector<slot> slots;  //  capacidad siempre potencia de 2
+  size_t used = 0;  //  ranuras con un valor
+  size_t deleted = 0;  //  ranuras marcadas como borradas
+  KeyFunction keyOf;
+  const void* owner;
+
+  static uint32_t hash(std::string_view name);
+  //  ranura que contiene el nombre o -1
+  long findSlot(std::string_view name, uint32_t h) const;
+  void rehash(size_t capacity);
+};
+
+#endif  //  NAMEINDEX_H
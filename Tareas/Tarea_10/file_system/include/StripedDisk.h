@@ -0,0 +1,49 @@
+#ifndef STRIPEDDISK_H
+#define STRIPEDDISK_H
+
+#include "VDisk.h"
+
+//  RAID-0 sobre varios discos: la imagen se corta en franjas de stripeBytes y
+//  la franja s va al disco s % N, en la posicion (s / N) * stripeBytes. La
+//  capacidad son N veces las franjas enteras del disco mas chico: lo que un
+//  disco mas grande tiene de mas no se usa. Los lotes se reparten entre los
+//  discos y se hacen en paralelo con la E/S asincrona de cada uno, asi con
+//  las imagenes en unidades distintas el ancho de banda tambien se suma
+class StripedDisk : public VDisk {
+ public:
+  //  StripedDisk se queda con los discos y los borra al final
+  StripedDisk(const std::vector<VDisk*>& disks, size_t stripeBytes);
+  ~StripedDisk();
+
+  int read(size_t offset, void* buffer, size_t size);
+  int write(size_t offset, const void* buffer, size_t size);
+  int writeBatch(std::vector<diskWrite>& writes);
+  int readBatch(std::vector<diskRead>& reads);
+  //  cada disco recibe su parte con su propio readAsync; done llega con el ultimo
+  void readAsync(std::vector<diskRead> reads, std::function<void(int)> done);
+  void writeAsync(std::vector<diskWrite> writes, std::function<void(int)> done);
+  int sync();
+  void syncAsync(std::function<void(int)> done);
+  int discard(size_t offset, size_t size);
+  int provision(size_t offset, size_t size);
+
+ private:
+  std::vector<VDisk*> disks;
+  size_t stripeBytes;
+
+  //  cortar [offset, offset + size) en tramos que no cruzan franjas y
+  //  entregar cada uno con su disco, su offset en el disco y su posicion
+  //  dentro del rango
+  void split(size_t offset, size_t size, const std::function<void(size_t disk, size_t diskOffset, size_t position, size_t length)>& piece);
+  //  start(d, done) entrega su parte a cada disco con trabajo sin esperarla; done
+  //  se llama una vez, con el ultimo, y recibe -1 si alguno fallo
+  void onEachDisk(const std::vector<bool>& busy,
+                  const std::function<void(size_t disk, std::function<void(int)> done)>& start,
+                  std::function<void(int)> done);
+  //  empezar una operacion asincrona y esperar su done
+  static int wait(const std::function<void(std::function<void(int)> done)>& start);
+  //  discard y provision: apply con el tramo de cada disco que cae en el rango
+  int eachRange(size_t offset, size_t size, const std::function<int(VDisk* disk, size_t diskOffset, size_t length)>& apply);
+};
+
+#endif  //  STRIPEDDISK_H
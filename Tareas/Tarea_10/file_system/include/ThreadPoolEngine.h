@@ -0,0 +1,39 @@
+#ifndef THREADPOOLENGINE_H
+#define THREADPOOLENGINE_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include "IOEngine.h"
+
+//  motor de reemplazo: una cola de operaciones que varios hilos atienden con
+//  pread/pwrite, asi las de un lote igual se hacen en paralelo
+class ThreadPoolEngine : public IOEngine {
+ public:
+  explicit ThreadPoolEngine(unsigned threads);
+  ~ThreadPoolEngine();
+
+  void submit(const std::vector<ioRequest>& batch, std::function<void(int)> done);
+  //  correr job en uno de los hilos, en orden con las operaciones de la cola
+  void post(std::function<void()> job);
+
+ private:
+  typedef struct task {
+    ioRequest request;
+    batchState* state;
+    std::function<void()> job;  //  si no esta vacio, la tarea es esto y no request
+  } task;
+
+  std::vector<std::thread> workers;
+  std::deque<task> queue;
+  std::mutex lock;
+  std::condition_variable ready;
+  bool stopping = false;
+
+  void work();
+  //  la operacion completa, siguiendo despues de lecturas o escrituras cortas
+  static bool transfer(const ioRequest& request);
+};
+
+#endif  //  THREADPOOLENGINE_H
@@ -0,0 +1,69 @@
+#ifndef URINGENGINE_H
+#define URINGENGINE_H
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include "IOEngine.h"
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+//  motor sobre io_uring con las llamadas al sistema directas, sin liburing:
+//  un lote entra al anillo con un solo io_uring_enter y un hilo recoge las
+//  terminaciones. Como mucho IO_QUEUE_DEPTH operaciones estan en vuelo
+class UringEngine : public IOEngine {
+ public:
+  //  lanza std::runtime_error si el kernel no deja crear el anillo o le
+  //  falta alguna de las operaciones que se usan
+  explicit UringEngine(unsigned depth);
+  ~UringEngine();
+
+  void submit(const std::vector<ioRequest>& batch, std::function<void(int)> done);
+
+ private:
+  typedef struct operation {
+    ioRequest request;  //  lo que falta de la operacion
+    batchState* state;
+  } operation;
+
+  int ringFd = -1;
+  void* sqRing = nullptr;
+  size_t sqRingSize = 0;
+  void* cqRing = nullptr;
+  size_t cqRingSize = 0;
+  io_uring_sqe* sqes = nullptr;
+  size_t sqesSize = 0;
+
+  //  punteros dentro de los anillos compartidos con el kernel
+  unsigned* sqTail;
+  unsigned sqMask;
+  unsigned* sqArray;
+  unsigned sqEntries;
+  unsigned* cqHead;
+  unsigned* cqTail;
+  unsigned cqMask;
+  io_uring_cqe* cqes;
+
+  std::mutex lock;  //  cola de entrega e inFlight
+  std::condition_variable space;
+  unsigned inFlight = 0;
+  std::unordered_set<operation*> active;  //  las operaciones en el kernel, para fallarlas si el anillo se rompe
+  bool broken = false;  //  io_uring_enter dejo de funcionar: todo lote nuevo falla
+  std::thread reaper;
+
+  //  poner la operacion en la cola de entrega; con lock tomado
+  void push(operation* op);
+  //  entregar al kernel las ultimas count operaciones; con lock tomado. Si el
+  //  kernel las rechaza se sacan de la cola y quedan en rejected para fallarlas
+  int flush(unsigned count, std::vector<operation*>& rejected);
+  //  hilo que espera las terminaciones y cierra los lotes
+  void reap();
+  //  el anillo ya no da terminaciones: fallar lo que estaba en vuelo
+  void fail();
+  void finish(operation* op, int result);
+  void unmap();
+};
+
+#endif  //  URINGENGINE_H
@@ -0,0 +1,69 @@
+#ifndef VDISK_H
+#define VDISK_H
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+//  una escritura de un lote: size bytes de buffer hacia offset
+typedef struct diskWrite {
+  size_t offset;
+  const void* buffer;
+  size_t size;
+} diskWrite;
+
+//  una lectura de un lote: size bytes desde offset hacia buffer
+typedef struct diskRead {
+  size_t offset;
+  void* buffer;
+  size_t size;
+} diskRead;
+
+//  clase base de los discos virtuales sobre los que trabaja FS
+//  todas las direcciones son offsets en bytes desde el inicio de la imagen
+//  read y write se pueden llamar desde varios hilos a la vez sobre rangos
+//  distintos, por eso las implementaciones no guardan una posicion actual
+class VDisk {
+ public:
+  virtual ~VDisk();
+
+  //  copiar size bytes desde offset hacia buffer, retorna 0 o -1
+  virtual int read(size_t offset, void* buffer, size_t size) = 0;
+  //  copiar size bytes desde buffer hacia offset, retorna 0 o -1
+  virtual int write(size_t offset, const void* buffer, size_t size) = 0;
+  //  aplicar varias escrituras juntas; puede reordenar el vector y hacerlas en
+  //  paralelo, asi que las escrituras de un lote no se pisan entre si
+  virtual int writeBatch(std::vector<diskWrite>& writes);
+  //  hacer varias lecturas juntas; por defecto una despues de la otra
+  virtual int readBatch(std::vector<diskRead>& reads);
+  //  readBatch sin esperar: done recibe 0 o -1 cuando termina, desde otro hilo
+  //  si el disco tiene E/S asincrona. Los buffers tienen que vivir hasta done;
+  //  por defecto se hace readBatch y se llama done antes de retornar
+  virtual void readAsync(std::vector<diskRead> reads, std::function<void(int)> done);
+  //  lo mismo para writeBatch y sync; por defecto tambien se hacen antes de retornar
+  virtual void writeAsync(std::vector<diskWrite> writes, std::function<void(int)> done);
+  virtual void syncAsync(std::function<void(int)> done);
+  //  aviso de que el rango se va a leer pronto; solo un disco con cache lo
+  //  aprovecha, por defecto no hace nada
+  virtual void prefetch(size_t offset, size_t size);
+  //  punto de persistencia: todo lo escrito antes queda en el medio fisico
+  virtual int sync() = 0;
+  //  el rango ya no guarda nada util: el disco puede devolver su espacio y
+  //  despues leerlo como ceros. Por defecto no hace nada
+  virtual int discard(size_t offset, size_t size);
+  //  reservar espacio real para el rango, asi escribirlo nunca falla por falta
+  //  de espacio en el host. Por defecto no hace nada
+  virtual int provision(size_t offset, size_t size);
+
+  size_t size() const;
+
+ protected:
+  size_t diskSize = 0;  //  tamano de la imagen en bytes
+
+  //  fallocate sobre un archivo de imagen; un sistema de archivos del host que no
+  //  soporta el modo no es un error, el rango simplemente queda como estaba
+  static int fallocateRange(int fd, int mode, size_t offset, size_t size);
+};
+
+#endif  //  VDISK_H
@@ -0,0 +1,155 @@
+#include "../include/BitMap.h"
+#include <algorithm>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+static const uint64_t FULL_WORD = ~(uint64_t)0;
+
+BitMap::BitMap() {
+}
+
+BitMap::BitMap(size_t bits) {
+  this->resize(bits);
+}
+
+void BitMap::resize(size_t bits) {
+  this->totalBits = bits;
+  this->words.assign((bits + 63) / 64, 0);
+  //  un mapa recien creado se tiene que escribir completo
+  this->dirtyWords.assign((this->words.size() + 63) / 64, FULL_WORD);
+
+  //  los bits de relleno de la ultima palabra quedan ocupados para que nunca se asignen
+  size_t tail = bits % 64;
+  if (tail != 0) {
+    this->words.back() = FULL_WORD << tail;
+  }
+}
+
+bool BitMap::test(size_t bit) const {
+  return (this->words[bit / 64] >> (bit % 64)) & 1;
+}
+
+void BitMap::set(size_t bit) {
+  this->words[bit / 64] |= (uint64_t)1 << (bit % 64);
+  this->markDirty(bit / 64);
+}
+
+void BitMap::clear(size_t bit) {
+  this->words[bit / 64] &= ~((uint64_t)1 << (bit % 64));
+  this->markDirty(bit / 64);
+}
+
+void BitMap::markDirty(size_t word) {
+  this->dirtyWords[word / 64] |= (uint64_t)1 << (word % 64);
+}
+
+void BitMap::takeDirtyWords(std::vector<size_t>& out) {
+  out.clear();
+  for (size_t i = 0; i < this->dirtyWords.size(); i++) {
+    uint64_t pending = this->dirtyWords[i];
+    while (pending != 0) {
+      size_t word = i * 64 + __builtin_ctzll(pending);
+      if (word < this->words.size()) {
+        out.push_back(word);
+      }
+      pending &= pending - 1;
+    }
+    this->dirtyWords[i] = 0;
+  }
+}
+
+#if defined(__x86_64__)
+//  compara 4 palabras por iteracion contra ~0; solo se usa si el CPU tiene AVX2
+__attribute__((target("avx2")))
+static long findNonFullWordAvx2(const uint64_t* words, size_t first, size_t count) {
+  const __m256i full = _mm256_set1_epi64x(-1);
+  size_t i = first;
+  for (; i + 4 <= count; i += 4) {
+    __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(words + i));
+    int mask = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(chunk, full)));
+    if (mask != 0xF) {
+      return i + __builtin_ctz(~mask & 0xF);
+    }
+  }
+  for (; i < count; i++) {
+    if (words[i] != FULL_WORD) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static const bool HAS_AVX2 = __builtin_cpu_supports("avx2");
+#endif
+
+long BitMap::findNonFullWord(size_t first) const {
+#if defined(__x86_64__)
+  if (HAS_AVX2) {
+    return findNonFullWordAvx2(this->words.data(), first, this->words.size());
+  }
+#endif
+  for (size_t i = first; i < this->words.size(); i++) {
+    if (this->words[i] != FULL_WORD) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+long BitMap::findFirstZero(size_t from) const {
+  if (from >= this->totalBits) {
+    return -1;
+  }
+
+  //  la primera palabra puede empezar a mitad: se ocultan los bits anteriores a from
+  size_t word = from / 64;
+  uint64_t freeBits = ~this->words[word] & (FULL_WORD << (from % 64));
+  if (freeBits != 0) {
+    return word * 64 + __builtin_ctzll(freeBits);
+  }
+
+  long next = this->findNonFullWord(word + 1);
+  if (next == -1) {
+    return -1;
+  }
+  return next * 64 + __builtin_ctzll(~this->words[next]);
+}
+
+size_t BitMap::zeroRunLength(size_t from, size_t limit) const {
+  size_t length = 0;
+  size_t bit = from;
+  while (length < limit && bit < this->totalBits) {
+    //  los bits ocupados de la palabra, alineados a partir de bit
+    uint64_t used = this->words[bit / 64] >> (bit % 64);
+    size_t available = 64 - bit % 64;
+    size_t run = used == 0 ? available : std::min(available, (size_t)__builtin_ctzll(used));
+    length += run;
+    if (run < available) {
+      break;
+    }
+    bit += run;
+  }
+  return std::min(length, limit);
+}
+
+void BitMap::markClean() {
+  std::fill(this->dirtyWords.begin(), this->dirtyWords.end(), 0);
+}
+
+size_t BitMap::bits() const {
+  return this->totalBits;
+}
+
+size_t BitMap::bytes() const {
+  return this->words.size() * sizeof(uint64_t);
+}
+
+uint64_t* BitMap::data() {
+  return this->words.data();
+}
+
+const uint64_t* BitMap::data() const {
+  return this->words.data();
+}
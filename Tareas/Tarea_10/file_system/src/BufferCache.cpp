@@ -0,0 +1,362 @@
+#include "../include/BufferCache.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <memory>
+
+BufferCache::BufferCache(VDisk* inner, size_t blockSize, size_t frames)
+    : inner(inner), blockSize(blockSize) {
+  this->frames.assign(frames, frame{0, false, false, 0});
+  this->data.resize(frames * blockSize);
+  this->diskSize = inner->size();
+}
+
+BufferCache::~BufferCache() {
+  //  las lecturas adelantadas terminan en este objeto
+  std::unique_lock<std::mutex> guard(this->lock);
+  this->prefetched.wait(guard, [this] { return this->prefetchesPending == 0; });
+  guard.unlock();
+  delete this->inner;
+}
+
+char* BufferCache::frameData(size_t f) {
+  return this->data.data() + f * this->blockSize;
+}
+
+long BufferCache::evict() {
+  //  dos vueltas alcanzan para limpiar todos los bits de referencia
+  for (size_t step = 0; step < 2 * this->frames.size(); step++) {
+    size_t f = this->hand;
+    this->hand = (this->hand + 1) % this->frames.size();
+
+    frame& candidate = this->frames[f];
+    if (!candidate.valid) {
+      return f;
+    }
+    if (candidate.pins > 0) {
+      continue;
+    }
+    if (candidate.referenced) {
+      candidate.referenced = false;
+      continue;
+    }
+    this->blockToFrame.erase(candidate.block);
+    candidate.valid = false;
+    return f;
+  }
+  return -1;
+}
+
+long BufferCache::install(size_t block, const char* source) {
+  auto cached = this->blockToFrame.find(block);
+  if (cached != this->blockToFrame.end()) {
+    return cached->second;
+  }
+  long f = this->evict();
+  if (f == -1) {
+    return -1;
+  }
+  this->frames[f] = frame{block, true, false, 0};
+  memcpy(this->frameData(f), source, this->blockSize);
+  this->blockToFrame[block] = f;
+  return f;
+}
+
+int BufferCache::read(size_t offset, void* buffer, size_t size) {
+  std::vector<diskRead> reads = {{offset, buffer, size}};
+  return this->readBatch(reads);
+}
+
+int BufferCache::readBatch(std::vector<diskRead>& reads) {
+  std::vector<missingRun> runs;
+  std::unique_lock<std::mutex> guard(this->lock);
+  for (const diskRead& r : reads) {
+    if (r.offset + r.size > this->diskSize) {
+      return -1;
+    }
+
+    char* out = static_cast<char*>(r.buffer);
+    size_t offset = r.offset;
+    size_t end = offset + r.size;
+    while (offset < end) {
+      size_t block = offset / this->blockSize;
+      size_t inBlock = offset % this->blockSize;
+
+      auto cached = this->blockToFrame.find(block);
+      if (cached != this->blockToFrame.end()) {
+        this->hitCount++;
+        this->frames[cached->second].referenced = true;
+        size_t n = std::min(this->blockSize - inBlock, end - offset);
+        memcpy(out, this->frameData(cached->second) + inBlock, n);
+        out += n;
+        offset += n;
+        continue;
+      }
+      if (this->prefetching.count(block)) {
+        this->prefetched.wait(guard, [&] { return !this->prefetching.count(block); });
+        continue;
+      }
+
+      //  los bloques seguidos que faltan forman un tramo; todos los tramos del
+      //  lote se piden al disco de abajo juntos
+      size_t lastBlock = (end - 1) / this->blockSize;
+      size_t runEnd = block + 1;
+      while (runEnd <= lastBlock && !this->blockToFrame.count(runEnd) && !this->prefetching.count(runEnd)) {
+        runEnd++;
+      }
+      size_t runBytes = std::min((runEnd - block) * this->blockSize, this->diskSize - block * this->blockSize);
+      size_t n = std::min(runEnd * this->blockSize, end) - offset;
+      runs.push_back(missingRun{block, std::vector<char>(runBytes), out, inBlock, n});
+      out += n;
+      offset += n;
+    }
+  }
+  if (runs.empty()) {
+    return 0;
+  }
+
+  std::vector<diskRead> misses;
+  for (missingRun& run : runs) {
+    misses.push_back({run.block * this->blockSize, run.data.data(), run.data.size()});
+  }
+  uint64_t epoch = this->writeEpoch;
+  guard.unlock();
+  int result = this->inner->readBatch(misses);
+  for (const missingRun& run : runs) {
+    long corrupt = result == -1 ? -1 : this->firstCorrupt(run);
+    if (corrupt != -1) {
+      std::cout << "Bloque " << corrupt << " danado: su checksum no coincide\n";
+      return -1;
+    }
+  }
+  guard.lock();
+  if (result == -1) {
+    return -1;
+  }
+
+  //  si alguien escribio mientras tanto lo leido puede ser viejo: se usa
+  //  para esta lectura pero no se guarda
+  bool fresh = epoch == this->writeEpoch;
+  for (const missingRun& run : runs) {
+    size_t blocks = (run.data.size() + this->blockSize - 1) / this->blockSize;
+    for (size_t b = 0; b < blocks; b++) {
+      this->missCount++;
+      if (fresh && (b + 1) * this->blockSize <= run.data.size()) {
+        this->install(run.block + b, run.data.data() + b * this->blockSize);
+      }
+    }
+    memcpy(run.out, run.data.data() + run.skip, run.size);
+  }
+  return 0;
+}
+
+void BufferCache::prefetch(size_t offset, size_t size) {
+  if (offset >= this->diskSize || size == 0) {
+    return;
+  }
+  size_t lastBlock = (std::min(offset + size, this->diskSize) - 1) / this->blockSize;
+
+  auto runs = std::make_shared<std::vector<missingRun>>();
+  std::unique_lock<std::mutex> guard(this->lock);
+  size_t block = offset / this->blockSize;
+  while (block <= lastBlock) {
+    if (this->blockToFrame.count(block) || this->prefetching.count(block)) {
+      block++;
+      continue;
+    }
+    size_t runEnd = block + 1;
+    while (runEnd <= lastBlock && !this->blockToFrame.count(runEnd) && !this->prefetching.count(runEnd)) {
+      runEnd++;
+    }
+    size_t runBytes = std::min((runEnd - block) * this->blockSize, this->diskSize - block * this->blockSize);
+    runs->push_back(missingRun{block, std::vector<char>(runBytes), nullptr, 0, 0});
+    for (size_t b = block; b < runEnd; b++) {
+      this->prefetching.insert(b);
+    }
+    block = runEnd;
+  }
+  if (runs->empty()) {
+    return;
+  }
+
+  std::vector<diskRead> reads;
+  for (missingRun& run : *runs) {
+    reads.push_back({run.block * this->blockSize, run.data.data(), run.data.size()});
+  }
+  uint64_t epoch = this->writeEpoch;
+  this->prefetchesPending++;
+  guard.unlock();
+
+  //  runs viaja con la funcion: los buffers viven hasta que la lectura termina
+  this->inner->readAsync(std::move(reads), [this, runs, epoch](int result) {
+    //  un tramo danado no entra; la lectura que lo necesite lo va a reportar
+    std::vector<bool> usable;
+    for (const missingRun& run : *runs) {
+      usable.push_back(result == 0 && this->firstCorrupt(run) == -1);
+    }
+
+    std::lock_guard<std::mutex> guard(this->lock);
+    bool fresh = epoch == this->writeEpoch;
+    for (size_t r = 0; r < runs->size(); r++) {
+      const missingRun& run = (*runs)[r];
+      size_t blocks = (run.data.size() + this->blockSize - 1) / this->blockSize;
+      for (size_t b = 0; b < blocks; b++) {
+        if (fresh && usable[r] && (b + 1) * this->blockSize <= run.data.size()) {
+          this->install(run.block + b, run.data.data() + b * this->blockSize);
+        }
+        this->prefetching.erase(run.block + b);
+      }
+    }
+    this->prefetchesPending--;
+    this->prefetched.notify_all();
+  });
+}
+
+long BufferCache::firstCorrupt(const missingRun& run) {
+  if (!this->verify) {
+    return -1;
+  }
+  for (size_t b = 0; (b + 1) * this->blockSize <= run.data.size(); b++) {
+    if (!this->verify(run.block + b, run.data.data() + b * this->blockSize)) {
+      return run.block + b;
+    }
+  }
+  return -1;
+}
+
+void BufferCache::setVerifier(std::function<bool(size_t block, const char* data)> verify) {
+  this->verify = std::move(verify);
+}
+
+int BufferCache::readDirect(size_t offset, void* buffer, size_t size) {
+  return this->inner->read(offset, buffer, size);
+}
+
+void BufferCache::update(size_t offset, const void* buffer, size_t size) {
+  const char* in = static_cast<const char*>(buffer);
+  size_t end = offset + size;
+  while (offset < end) {
+    size_t block = offset / this->blockSize;
+    size_t inBlock = offset % this->blockSize;
+    size_t n = std::min(this->blockSize - inBlock, end - offset);
+
+    //  sin asignar en escritura: solo se actualizan los bloques que ya estan
+    auto cached = this->blockToFrame.find(block);
+    if (cached != this->blockToFrame.end()) {
+      memcpy(this->frameData(cached->second) + inBlock, in, n);
+    }
+    in += n;
+    offset += n;
+  }
+}
+
+int BufferCache::write(size_t offset, const void* buffer, size_t size) {
+  if (this->inner->write(offset, buffer, size) == -1) {
+    return -1;
+  }
+  std::lock_guard<std::mutex> guard(this->lock);
+  this->writeEpoch++;
+  this->update(offset, buffer, size);
+  return 0;
+}
+
+int BufferCache::writeBatch(std::vector<diskWrite>& writes) {
+  //  el disco de abajo sigue juntando el lote a su manera
+  int result = this->inner->writeBatch(writes);
+  std::lock_guard<std::mutex> guard(this->lock);
+  this->writeEpoch++;
+  for (const diskWrite& w : writes) {
+    this->update(w.offset, w.buffer, w.size);
+  }
+  return result;
+}
+
+int BufferCache::sync() {
+  return this->inner->sync();
+}
+
+int BufferCache::discard(size_t offset, size_t size) {
+  int result = this->inner->discard(offset, size);
+
+  //  solo los bloques completos del rango dejan de tener contenido
+  std::lock_guard<std::mutex> guard(this->lock);
+  this->writeEpoch++;
+  size_t first = (offset + this->blockSize - 1) / this->blockSize;
+  size_t last = (offset + size) / this->blockSize;
+  for (size_t block = first; block < last; block++) {
+    auto cached = this->blockToFrame.find(block);
+    if (cached == this->blockToFrame.end()) {
+      continue;
+    }
+    frame& f = this->frames[cached->second];
+    if (f.pins > 0) {
+      //  quien lo tiene fijo ve lo mismo que leeria del disco
+      memset(this->frameData(cached->second), 0, this->blockSize);
+    } else {
+      f.valid = false;
+      this->blockToFrame.erase(cached);
+    }
+  }
+  return result;
+}
+
+int BufferCache::provision(size_t offset, size_t size) {
+  return this->inner->provision(offset, size);
+}
+
+const char* BufferCache::pin(size_t block) {
+  std::unique_lock<std::mutex> guard(this->lock);
+  //  un bloque pedido por prefetch se espera en vez de leerlo otra vez
+  this->prefetched.wait(guard, [&] { return !this->prefetching.count(block); });
+  auto cached = this->blockToFrame.find(block);
+  long f;
+  if (cached != this->blockToFrame.end()) {
+    this->hitCount++;
+    f = cached->second;
+  } else {
+    this->missCount++;
+    std::vector<char> buffer(this->blockSize);
+    //  el frame tiene que quedar con lo ultimo escrito: se lee de nuevo si
+    //  alguien escribio mientras se leia sin el lock
+    uint64_t epoch;
+    bool ok;
+    do {
+      epoch = this->writeEpoch;
+      guard.unlock();
+      int result = this->inner->read(block * this->blockSize, buffer.data(), this->blockSize);
+      ok = result == 0 && (!this->verify || this->verify(block, buffer.data()));
+      guard.lock();
+      if (result == -1) {
+        return nullptr;
+      }
+    } while (epoch != this->writeEpoch && !this->blockToFrame.count(block));
+    //  uno danado no se fija: el read con el que sigue quien llamo lo reporta
+    if (!ok && !this->blockToFrame.count(block)) {
+      return nullptr;
+    }
+    if ((f = this->install(block, buffer.data())) == -1) {
+      return nullptr;
+    }
+  }
+  this->frames[f].referenced = true;
+  this->frames[f].pins++;
+  return this->frameData(f);
+}
+
+void BufferCache::unpin(size_t block) {
+  std::lock_guard<std::mutex> guard(this->lock);
+  auto cached = this->blockToFrame.find(block);
+  if (cached != this->blockToFrame.end() && this->frames[cached->second].pins > 0) {
+    this->frames[cached->second].pins--;
+  }
+}
+
+uint64_t BufferCache::hits() const {
+  std::lock_guard<std::mutex> guard(this->lock);
+  return this->hitCount;
+}
+
+uint64_t BufferCache::misses() const {
+  std::lock_guard<std::mutex> guard(this->lock);
+  return this->missCount;
+}
@@ -0,0 +1,93 @@
+#include "../include/Crc32c.h"
+#include <cstring>
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+//  polinomio de Castagnoli con los bits invertidos
+static const uint32_t POLYNOMIAL = 0x82F63B78u;
+
+//  slicing-by-8: tables[k][b] es el crc del byte b seguido de k bytes en cero,
+//  asi 8 bytes se resuelven con 8 busquedas independientes
+typedef struct crcTables {
+  uint32_t t[8][256];
+
+  crcTables() {
+    for (uint32_t b = 0; b < 256; b++) {
+      uint32_t crc = b;
+      for (int bit = 0; bit < 8; bit++) {
+        crc = (crc >> 1) ^ (POLYNOMIAL & (0u - (crc & 1)));
+      }
+      t[0][b] = crc;
+    }
+    for (uint32_t b = 0; b < 256; b++) {
+      for (int k = 1; k < 8; k++) {
+        t[k][b] = (t[k - 1][b] >> 8) ^ t[0][t[k - 1][b] & 0xFF];
+      }
+    }
+  }
+} crcTables;
+
+static const crcTables tables;
+
+#if defined(__x86_64__)
+static const bool sse42 = __builtin_cpu_supports("sse4.2");
+#else
+static const bool sse42 = false;
+#endif
+
+uint32_t Crc32c::compute(const void* data, size_t size, uint32_t crc) {
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  crc = ~crc;
+  crc = sse42 ? withInstruction(crc, bytes, size) : withTables(crc, bytes, size);
+  return ~crc;
+}
+
+bool Crc32c::hardware() {
+  return sse42;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+uint32_t Crc32c::withInstruction(uint32_t crc, const unsigned char* data, size_t size) {
+  uint64_t c = crc;
+  while (size >= 8) {
+    uint64_t word;
+    memcpy(&word, data, 8);
+    c = _mm_crc32_u64(c, word);
+    data += 8;
+    size -= 8;
+  }
+  crc = (uint32_t)c;
+  while (size > 0) {
+    crc = _mm_crc32_u8(crc, *data++);
+    size--;
+  }
+  return crc;
+}
+#else
+uint32_t Crc32c::withInstruction(uint32_t crc, const unsigned char* data, size_t size) {
+  return withTables(crc, data, size);
+}
+#endif
+
+uint32_t Crc32c::withTables(uint32_t crc, const unsigned char* data, size_t size) {
+  while (size >= 8) {
+    uint32_t low;
+    uint32_t high;
+    memcpy(&low, data, 4);
+    memcpy(&high, data + 4, 4);
+    low ^= crc;
+    crc = tables.t[7][low & 0xFF] ^ tables.t[6][(low >> 8) & 0xFF] ^
+          tables.t[5][(low >> 16) & 0xFF] ^ tables.t[4][low >> 24] ^
+          tables.t[3][high & 0xFF] ^ tables.t[2][(high >> 8) & 0xFF] ^
+          tables.t[1][(high >> 16) & 0xFF] ^ tables.t[0][high >> 24];
+    data += 8;
+    size -= 8;
+  }
+  while (size > 0) {
+    crc = (crc >> 8) ^ tables.t[0][(crc ^ *data++) & 0xFF];
+    size--;
+  }
+  return crc;
+}
@@ -1,160 +1,626 @@
 #include "../include/FS.h"
+#include "../include/FileDisk.h"
+#include "../include/MmapDisk.h"
+#include "../include/MemoryDisk.h"
+#include "../include/Crc32c.h"
 #include <iostream>
 
-FS::FS() {
-  this->diskFile.open("diskFile.bin", std::ios::in | std::ios::out | std::ios::binary);
-  if (!this->diskFile.is_open()) {
-    this->diskFile.open("diskFile.bin", std::ios::out | std::ios::binary);
-    this->diskFile.close();
-    this->diskFile.open("diskFile.bin", std::ios::in | std::ios::out | std::ios::binary);
+FS::FS(DiskBackend backend, bool format) : nameIndex(FS::inodeName, this) {
+  this->openDisk(backend);
 
-    if (!this->diskFile.is_open()) {
-      std::cout << "Could not create diskFile" << std::endl;
-      exit(1);
-    }
+  //  solo se formatea una imagen sin sistema de archivos; una que no se pudo
+  //  leer o es de otra version queda como esta
+  int mounted = format ? MOUNT_EMPTY : this->mount();
+  if (mounted == -1 || (mounted == MOUNT_EMPTY && this->format() == -1)) {
+    std::cout << "Could not mount or format diskFile" << std::endl;
+    exit(1);
+  }
+}
 
+FS::FS(VDisk* image, bool format) : nameIndex(FS::inodeName, this) {
+  this->openDisk(image);
+  int mounted = format ? MOUNT_EMPTY : this->mount();
+  if (mounted == -1 || (mounted == MOUNT_EMPTY && this->format() == -1)) {
+    std::cout << "Could not mount or format disk" << std::endl;
+    exit(1);
   }
+}
 
-  sb.TotalBlocks = TOTAL_BLOCKS;
-  sb.blockSize = BLOCK_SIZE;
-  sb.freeBlocks = TOTAL_BLOCKS;
-  sb.maxInodes = DIRECTORY_SIZE;
-  sb.usedInodes = 0;
+FS::FS(const std::string& snapshot, DiskBackend backend) : nameIndex(FS::inodeName, this) {
+  this->openDisk(backend);
+  if (this->mountSnapshot(snapshot) == -1) {
+    delete this->disk;
+    throw std::runtime_error("FS: no existe el snapshot \"" + snapshot + "\"");
+  }
+}
+
+void FS::openDisk(DiskBackend backend) {
+  try {
+    VDisk* image;
+    if (backend == DiskBackend::Mmap) {
+      image = new MmapDisk("diskFile.bin", (size_t)TOTAL_BLOCKS * BLOCK_SIZE);
+    } else if (backend == DiskBackend::Memory) {
+      image = new MemoryDisk((size_t)TOTAL_BLOCKS * BLOCK_SIZE);
+    } else {
+      image = new FileDisk("diskFile.bin", (size_t)TOTAL_BLOCKS * BLOCK_SIZE);
+    }
+    this->openDisk(image);
+  } catch (const std::exception& e) {
+    std::cout << "Could not create diskFile: " << e.what() << std::endl;
+    exit(1);
+  }
+}
+
+void FS::openDisk(VDisk* image) {
+  this->disk = new BufferCache(image, BLOCK_SIZE, CACHE_BLOCKS);
+  this->disk->setVerifier([this](size_t block, const char* data) {
+    return this->verifyBlock(block, data);
+  });
+}
 
-  inodesTable.resize(sb.maxInodes);  //  tabla de inodeSize maximo de inodos
-  bitMap.resize(sb.TotalBlocks, 0); // 0 = libre, 1 = ocupado
+void FS::resetState() {
+  //  un commit anterior puede estar todavia escribiendo sin metaLock
+  std::lock_guard<std::mutex> io(this->commitLock);
+  this->committingMeta.clear();
+  this->journalFailed = false;
+  this->nameIndex.clear();
+  this->blockMaps.clear();
+  this->readAheads.clear();
+  this->inodesTable.clear();
+  this->dirtyInodeBlocks.clear();
+  this->dirtyMeta.clear();
+  this->journalSequence = 1;
+  this->journalHead = 0;
+  this->blocksFreed = false;
+  this->journaledBlocks.clear();
+  this->revokedBlocks.clear();
+  this->pendingDiscards.clear();
+  this->freshBlocks.clear();
+  this->releasedBlocks.clear();
+  //  pinCounts sigue: las lecturas abiertas todavia hacen su release
+  this->pinnedFreed.clear();
+  this->unheldBlocks.clear();
+  this->pinHolder = -1;
+  std::lock_guard<std::mutex> guard(this->checksumLock);
+  this->checksums.clear();
+  this->overwritten.clear();
+  this->dirtyChecksumBlocks.clear();
+  this->freedChecksums.clear();
+  this->refCounts.clear();
+  this->blockHashes.clear();
+  this->dedupIndex.clear();
+}
 
+void FS::computeLayout() {
   //  super bloque blocks
   this->superBlockBlocks = 1;
   //  bitmap blocks
-  this->sizeBitMapBytes = sizeof(int) * sb.TotalBlocks;
+  this->sizeBitMapBytes = (this->sb.TotalBlocks + 63) / 64 * sizeof(uint64_t);
   this->bitMapBlocks = (this->sizeBitMapBytes + BLOCK_SIZE - 1) / BLOCK_SIZE;
-  //  tabla de inodos blocks
-  this->sizeTablaBytes = sizeof(inode) * inodesTable.size();
-  this->tableBlocks = (this->sizeTablaBytes + BLOCK_SIZE - 1) / BLOCK_SIZE;
+  this->bitMapStart = this->superBlockBlocks;
+  //  inodos por bloque de la tabla
+  this->inodesPerBlock = BLOCK_SIZE / sizeof(inode);
+}
+
+int FS::format() {
+  if (this->refuseWrite()) {
+    return -1;
+  }
+  std::unique_lock<std::shared_mutex> dir(this->dirLock);
+  std::lock_guard<std::mutex> meta(this->metaLock);
+  this->resetState();
+
+  sb = superBlock{};
+  savedSb = superBlock{};
+  savedSb.magic = ~FS_MAGIC;  //  distinto de sb: el primer commit lo escribe
+  sb.magic = FS_MAGIC;
+  sb.version = FS_VERSION;
+  sb.TotalBlocks = this->disk->size() / BLOCK_SIZE;  //  TOTAL_BLOCKS salvo con varias imagenes
+  sb.blockSize = BLOCK_SIZE;
+  sb.freeBlocks = sb.TotalBlocks;
+  sb.maxInodes = 0;  //  la tabla de inodos crece por tramos cuando se necesitan
+  sb.usedInodes = 0;
+  sb.firstFreeInode = -1;
+  sb.orphanInodes = -1;
+
+  this->computeLayout();
+  bitMap.resize(sb.TotalBlocks); // 0 = libre, 1 = ocupado
+  this->bitMapLoaded = true;
 
   int actualBlock = 0;
   
-  bitMap[actualBlock++] = 1;  //  espacio para el superBlock
-
-  bitMap[1] = 1;  //  espacio para el bitmap
+  bitMap.set(actualBlock++);  //  espacio para el superBlock
 
   for (int i = 0; i < this->bitMapBlocks; i++) {
-    bitMap[actualBlock++] = 1;
+    bitMap.set(actualBlock++);
   }
 
-  for (int i = 0; i < tableBlocks; i++) {
-    bitMap[actualBlock++] = 1;  //  se marcan los blocks usados por la tabla de inodos
+  //  junto al bitmap, las cuentas de referencias, los hashes de dedup y los
+  //  registros de snapshots; todo en cero: ningun bloque compartido ni con
+  //  hash y ningun snapshot
+  this->sb.refCountStart = actualBlock;
+  this->sb.refCountBlocks = (sb.TotalBlocks + REFCOUNTS_PER_BLOCK - 1) / REFCOUNTS_PER_BLOCK;
+  this->sb.dedupStart = this->sb.refCountStart + this->sb.refCountBlocks;
+  this->sb.dedupBlocks = (sb.TotalBlocks + HASHES_PER_BLOCK - 1) / HASHES_PER_BLOCK;
+  this->sb.snapshotStart = this->sb.dedupStart + this->sb.dedupBlocks;
+  int sharingBlocks = this->sb.refCountBlocks + this->sb.dedupBlocks + MAX_SNAPSHOTS;
+  std::vector<char> empty((size_t)sharingBlocks * BLOCK_SIZE, 0);
+  if (this->disk->write((size_t)actualBlock * BLOCK_SIZE, empty.data(), empty.size()) == -1) {
+    return -1;
+  }
+  for (int i = 0; i < sharingBlocks; i++) {
+    bitMap.set(actualBlock++);
+  }
+  this->refCounts.assign(sb.TotalBlocks, 0);
+  this->blockHashes.assign(sb.TotalBlocks, hash128{0, 0});
+
+  //  el journal va despues del bitmap; se borra para que ninguna transaccion
+  //  de una imagen anterior se confunda con las nuevas. Su tamano depende de
+  //  las tablas fijas, asi que se calcula con todas ya medidas
+  this->sb.checksumBlocks = (sb.TotalBlocks + CHECKSUMS_PER_BLOCK - 1) / CHECKSUMS_PER_BLOCK;
+  this->sb.journalStart = actualBlock;
+  this->sb.journalBlocks = this->journalSize();
+  std::vector<char> zeros((size_t)this->sb.journalBlocks * BLOCK_SIZE, 0);
+  if (this->disk->write((size_t)actualBlock * BLOCK_SIZE, zeros.data(), zeros.size()) == -1) {
+    return -1;
+  }
+  for (int i = 0; i < this->sb.journalBlocks; i++) {
+    bitMap.set(actualBlock++);
+  }
+
+  //  la tabla de checksums sigue al journal y se escribe entera en el primer commit
+  this->sb.checksumStart = actualBlock;
+  for (int i = 0; i < this->sb.checksumBlocks; i++) {
+    bitMap.set(actualBlock++);
   }
+  this->resetChecksums();
+
+  int systemBlocks = actualBlock;
 
-  int systemBlocks = this->superBlockBlocks + this->bitMapBlocks + this->tableBlocks;
+  //  espacio real para los metadatos fijos y nada para el resto: los datos de
+  //  una imagen anterior no siguen ocupando el disco del host
+  size_t systemBytes = (size_t)systemBlocks * BLOCK_SIZE;
+  this->disk->provision(0, systemBytes);
+  this->disk->discard(systemBytes, (size_t)sb.TotalBlocks * BLOCK_SIZE - systemBytes);
 
   sb.freeBlocks -= systemBlocks;
+  this->countGroupFree();
 
   this->sb.firstFreeBlock = systemBlocks;
 
-  //  asegurar que el archivo tenga el inodeSize correcto
-  this->diskFile.seekp(TOTAL_BLOCKS * BLOCK_SIZE - 1);
-  this->diskFile.write("", 1);
-  this->diskFile.flush();
+  //  la tabla de inodos es un archivo sin nombre cuyo inode vive en el superBlock
+  sb.inodeTable = inode{};
+  sb.inodeTable.active = true;
+  resetExtents(sb.inodeTable);
 
-  saveChanges();
+  sb.dirRoot = allocateDirNode();
+  if (sb.dirRoot == -1 || growInodeTable() == -1) {
+    return -1;
+  }
+
+  //  el formato queda durable antes de la primera operacion
+  return this->commit();
+}
+
+int FS::mount() {
+  std::unique_lock<std::shared_mutex> dir(this->dirLock);
+  std::lock_guard<std::mutex> meta(this->metaLock);
+  superBlock stored;
+  if (this->disk->read(0, &stored, sizeof(superBlock)) == -1) {
+    std::cout << "No se pudo leer el superBlock" << std::endl;
+    return -1;
+  }
+  if (stored.magic != FS_MAGIC) {
+    return MOUNT_EMPTY;
+  }
+  if (stored.version != FS_VERSION || stored.blockSize != BLOCK_SIZE ||
+      (size_t)stored.TotalBlocks * BLOCK_SIZE > this->disk->size()) {
+    std::cout << "diskFile tiene un formato incompatible" << std::endl;
+    return -1;
+  }
+
+  this->resetState();
+  this->sb = stored;
+
+  //  terminar lo que un commit dejo a medias antes de confiar en lo demas
+  if (this->replayJournal() == -1 || this->disk->read(0, &this->sb, sizeof(superBlock)) == -1) {
+    std::cout << "No se pudo rehacer el journal" << std::endl;
+    return -1;
+  }
+  memcpy(&this->savedSb, &this->sb, sizeof(superBlock));
+
+  //  ademas de los checksums nada mas se lee ahora: el bitmap y la tabla de
+  //  inodos se cargan al usarlos
+  if (this->loadChecksums() == -1 || this->settleChecksums() == -1) {
+    std::cout << "No se pudieron leer los checksums" << std::endl;
+    return -1;
+  }
+  this->computeLayout();
+  this->bitMap.resize(this->sb.TotalBlocks);
+  this->bitMap.markClean();
+  this->bitMapLoaded = false;
+  this->inodesTable.resize(this->sb.maxInodes / this->inodesPerBlock);
+
+  //  un add que no termino deja su contenido nuevo en un huerfano
+  if (this->sb.orphanInodes != -1) {
+    while (this->sb.orphanInodes != -1) {
+      this->releaseOrphan(this->sb.orphanInodes);
+    }
+    return this->commit();
+  }
+  return 0;
+}
+
+void FS::loadBitMap() {
+  if (this->bitMapLoaded) {
+    return;
+  }
+  if (this->disk->read((size_t)this->bitMapStart * BLOCK_SIZE, this->bitMap.data(), this->bitMap.bytes()) == -1) {
+    std::cout << "No se pudo leer el bitmap\n";
+  }
+  this->bitMap.markClean();
+  this->countGroupFree();
+  this->loadSharing();
+  this->bitMapLoaded = true;
+}
+
+void FS::loadInodeBlock(int b) {
+  std::vector<inode>& block = this->inodesTable[b];
+  block.resize(this->inodesPerBlock);
+  size_t offset = (size_t)this->mapBlock(INODE_TABLE_NUMBER, b) * BLOCK_SIZE;
+  if (this->disk->read(offset, block.data(), this->inodesPerBlock * sizeof(inode)) == -1) {
+    std::cout << "No se pudo leer la tabla de inodos\n";
+  }
 }
 
 FS::~FS() {
-  this->diskFile.close();
+  //  los readAsync y writeAsync pendientes terminan antes del ultimo commit
+  delete this->workers;
+  //  lo que quedo fijo sin release se va con la cache
+  {
+    std::lock_guard<std::mutex> meta(this->metaLock);
+    this->pinCounts.clear();
+    for (int block : this->unheldBlocks) {
+      this->releaseBlock(block);
+    }
+    if (this->pinHolder != -1) {
+      this->releaseOrphan(this->pinHolder);
+    }
+  }
+  //  todo lo escrito llega al disco con este ultimo commit
+  this->clearOverwrites();
+  this->sync();
+  delete this->disk;
 }
 
 int FS::create(const std::string& name) {
-  if (this->searchInode(name) != -1 || this->sb.maxInodes <= sb.usedInodes){ 
+  durableScope durable(this);
+  if (this->refuseWrite()) {
+    throw std::runtime_error("FS::create failed");
+  }
+  //  un nombre que no entra en inode.name quedaria truncado y chocaria con
+  //  otro que empiece igual
+  if (name.empty() || name.size() >= MAX_NAME_LENGTH) {
+    throw std::runtime_error("FS::create failed");
+  }
+  std::unique_lock<std::shared_mutex> dir(this->dirLock);
+  std::lock_guard<std::mutex> meta(this->metaLock);
+  if (this->searchInode(name) != -1){ 
     throw std::runtime_error("FS::create failed");
   }
 
-  int freeNode = -1;
-  for (int i = 0; i < sb.maxInodes; i++) {
-    if (!inodesTable[i].active) {
-      freeNode = i;
-      break;
-    }
+  int freeNode = this->allocateInode();
+  if (freeNode == -1) {
+    throw std::runtime_error("FS::create failed");
   }
 
-  inode newInode = this->inodesTable[freeNode];
-  memset(&newInode, 0, sizeof(inode));
+  inode newInode{};
   strncpy(newInode.name, name.c_str(), MAX_NAME_LENGTH - 1);
   std::string actualDate = getActualDate();
   strncpy(newInode.date, actualDate.c_str(), MAX_DATE_LENGTH - 1);
   newInode.inodeSize = 0;
   newInode.active = true;
+  newInode.nextFreeInode = -1;
+  resetExtents(newInode);
+
+  this->inodeAt(freeNode) = newInode;
+  this->markInodeDirty(freeNode);
+  if (this->dirInsert(this->inodeAt(freeNode).name, freeNode) == -1) {
+    this->inodeAt(freeNode).active = false;
+    this->inodeAt(freeNode).nextFreeInode = this->sb.firstFreeInode;
+    this->sb.firstFreeInode = freeNode;
+    throw std::runtime_error("FS::create failed");
+  }
+  this->sb.usedInodes++;
+  this->nameIndex.insert(this->inodeAt(freeNode).name, freeNode);
+
+  saveChanges();
+
+  return 0;
+}
 
-  for (int i = 0; i < DIRECT_BLOCK_SIZE; i++) {
-    newInode.directBlocks[i] = -1;
+int FS::add(const std::string &name, const std::string& data, bool compress, bool dedup) {
+  durableScope durable(this);
+  if (this->refuseWrite()) {
+    return -1;
+  }
+  std::shared_lock<std::shared_mutex> dir(this->dirLock);
+  // searchInode inode con ese name
+  int index = this->lookup(name);
+  if (index == -1) {
+    std::cout << "File \"" << name << "\" does not exist." << std::endl;
+    return -1;
   }
 
-  for (int i = 0; i < INDIRECT_BLOCK_SIZE; i++) {
-    newInode.indirectBlocks[i] = -1;
+  if (compress && dedup) {
+    std::cout << "No se puede comprimir y deduplicar el mismo archivo" << std::endl;
+    return -1;
+  }
+
+  //  el contenido nuevo se escribe en un inode aparte y el archivo lo toma
+  //  recien cuando esta completo: un add que falla deja el contenido anterior.
+  //  Para eso tienen que entrar el contenido anterior y el nuevo a la vez; si
+  //  no, el archivo se vacia primero y se escribe en su lugar, y un fallo a
+  //  mitad de camino lo deja vacio
+  std::unique_lock<std::shared_mutex> file(this->inodeLock(index));
+  int scratch = -1;
+  {
+    std::lock_guard<std::mutex> meta(this->metaLock);
+    //  lo que ocupa comprimido o deduplicado recien se sabe al escribirlo:
+    //  sin comprimir es una cota
+    int blocksNeeded = data.size() <= INLINE_DATA_SIZE ? 0 : (int)((data.size() + this->sb.blockSize -1) / this->sb.blockSize);
+    if (blocksNeeded <= this->sb.freeBlocks) {
+      scratch = this->allocateOrphan(compress, dedup);
+      if (scratch == -1) {
+        std::cout << "Insufficient space to store this file" << std::endl;
+        return -1;
+      }
+    } else {
+      //  en su lugar cuenta tambien con los bloques que el archivo devuelve
+      //  (los compartidos y los de una lectura con pin siguen ocupados), con
+      //  lugar para los bloques de extents, porque un fallo ya no tiene vuelta
+      int propios = 0;
+      for (const extent& e : this->getBlockMap(index)->extents) {
+        for (int b = e.start; b < e.start + e.length; b++) {
+          propios += this->refCounts[b] == 0 && !this->pinCounts.count(b);
+        }
+      }
+      if (!compress && !dedup && blocksNeeded + INDIRECT_BLOCK_SIZE > this->sb.freeBlocks + propios) {
+        std::cout << "Insufficient space to store this file" << std::endl;
+        return -1;
+      }
+      this->freeDataBlocks(index);
+      inode& node = this->inodeAt(index);
+      node.inodeSize = 0;
+      node.compressed = compress;
+      node.deduped = dedup;
+      this->markInodeDirty(index);
+    }
+  }
+
+  long written = writeAt(scratch != -1 ? scratch : index, 0, data.data(), data.size());
+  std::lock_guard<std::mutex> meta(this->metaLock);
+  if (written == -1) {
+    std::cout << "Error al escribir datos en disco\n";
+    if (scratch != -1) {
+      this->releaseOrphan(scratch);
+    }
+    saveChanges();
+    return -1;
+  }
+  if (scratch == -1) {
+    saveChanges();
+    return 0;
   }
 
-  this->inodesTable[this->sb.usedInodes++] = newInode;
+  //  el archivo y el huerfano intercambian contenido en la misma transaccion
+  //  en la que se liberan los bloques anteriores
+  inode& node = this->inodeAt(index);
+  inode& nuevo = this->inodeAt(scratch);
+  std::swap(node.inodeSize, nuevo.inodeSize);
+  std::swap(node.compressed, nuevo.compressed);
+  std::swap(node.deduped, nuevo.deduped);
+  std::swap(node.extentCount, nuevo.extentCount);
+  std::swap(node.extents, nuevo.extents);
+  std::swap(node.indirectBlocks, nuevo.indirectBlocks);
+  std::swap(node.inlineData, nuevo.inlineData);
+  for (int number : {index, scratch}) {
+    this->blockMaps.erase(number);
+    this->readAheads.erase(number);
+  }
+  this->markInodeDirty(index);
+  this->releaseOrphan(scratch);
 
   saveChanges();
 
   return 0;
 }
 
-int FS::add(const std::string &name, const std::string& data) {
-  int index = -1;
-  int blocksNeeded;
+long FS::read(const std::string& name, size_t offset, std::span<char> buffer) {
+  std::shared_lock<std::shared_mutex> dir(this->dirLock);
+  int index = this->lookup(name);
+  if (index == -1) {
+    std::cout << "File \"" << name << "\" does not exist." << std::endl;
+    return -1;
+  }
 
-  // searchInode inode con ese name
-  index = this->searchInode(name);
+  std::shared_lock<std::shared_mutex> file(this->inodeLock(index));
+  size_t fileSize = this->sizeOf(index);
+  if (offset >= fileSize) {
+    return 0;
+  }
+
+  size_t size = std::min(buffer.size(), fileSize - offset);
+  if (this->readDisk(index, offset, buffer.data(), size) == -1) {
+    return -1;
+  }
+  return size;
+}
+
+long FS::write(const std::string& name, size_t offset, std::span<const char> data) {
+  durableScope durable(this);
+  std::shared_lock<std::shared_mutex> dir(this->dirLock);
+  int index = this->lookup(name);
   if (index == -1) {
     std::cout << "File \"" << name << "\" does not exist." << std::endl;
     return -1;
   }
 
-  // Obtener el inode
-  inode& node = inodesTable[index];
+  std::unique_lock<std::shared_mutex> file(this->inodeLock(index));
+  long written = this->writeAt(index, offset, data.data(), data.size());
+  std::lock_guard<std::mutex> meta(this->metaLock);
+  this->saveChanges();
+  return written;
+}
 
-  node.inodeSize = data.size();
-  blocksNeeded = (int)((node.inodeSize + this->sb.blockSize -1) / this->sb.blockSize);
-  if (blocksNeeded > this->sb.freeBlocks) {
-    std::cout << "Insufficient space to store this file" << std::endl;
+std::future<long> FS::readAsync(const std::string& name, size_t offset, std::span<char> buffer) {
+  return this->runAsync([this, name, offset, buffer] {
+    return this->read(name, offset, buffer);
+  });
+}
+
+std::future<long> FS::writeAsync(const std::string& name, size_t offset, std::span<const char> data) {
+  return this->runAsync([this, name, offset, data] {
+    return this->write(name, offset, data);
+  });
+}
+
+std::future<long> FS::runAsync(std::function<long()> operation) {
+  std::call_once(this->workersOnce, [this] {
+    this->workers = new ThreadPoolEngine(IO_POOL_THREADS);
+  });
+  std::shared_ptr<std::promise<long>> result = std::make_shared<std::promise<long>>();
+  std::future<long> future = result->get_future();
+  this->workers->post([result, operation = std::move(operation)] {
+    result->set_value(operation());
+  });
+  return future;
+}
+
+long FS::append(const std::string& name, std::span<const char> data) {
+  durableScope durable(this);
+  std::shared_lock<std::shared_mutex> dir(this->dirLock);
+  int index = this->lookup(name);
+  if (index == -1) {
+    std::cout << "File \"" << name << "\" does not exist." << std::endl;
     return -1;
   }
 
-  std::vector<int> blocks = findFreeBlock(blocksNeeded);
+  //  el final se toma con el lock del archivo, asi dos append no se pisan
+  std::unique_lock<std::shared_mutex> file(this->inodeLock(index));
+  long written = this->writeAt(index, this->sizeOf(index), data.data(), data.size());
+  std::lock_guard<std::mutex> meta(this->metaLock);
+  this->saveChanges();
+  return written;
+}
 
-  for (int i = 0; i < blocks.size(); i++) {
-    if (i < DIRECT_BLOCK_SIZE) {
-      node.directBlocks[i] = blocks[i];
-    } else {
-      node.indirectBlocks[i - DIRECT_BLOCK_SIZE] = blocks[i];
+long FS::read(const std::string& name, size_t offset, size_t size, std::ostream& out) {
+  std::shared_lock<std::shared_mutex> dir(this->dirLock);
+  int index = this->lookup(name);
+  if (index == -1) {
+    std::cout << "File \"" << name << "\" does not exist." << std::endl;
+    return -1;
+  }
+
+  std::shared_lock<std::shared_mutex> file(this->inodeLock(index));
+  return this->readTo(index, offset, size, out);
+}
+
+long FS::readTo(int index, size_t offset, size_t size, std::ostream& out) {
+  size_t fileSize = this->sizeOf(index);
+  if (offset >= fileSize) {
+    return 0;
+  }
+  size = std::min(size, fileSize - offset);
+
+  //  los bytes van de los frames de la cache al stream sin un buffer en el
+  //  medio, de a PIN_MAX_BLOCKS bloques fijos por vez
+  pinnedRead pinned;
+  size_t total = 0;
+  while (total < size) {
+    long chunk = this->pinRange(index, offset + total, size - total, pinned);
+    if (chunk == -1) {
+      this->unpinAll(pinned);
+      return -1;
     }
+    for (std::span<const char> span : pinned.spans) {
+      out.write(span.data(), span.size());
+    }
+    this->unpinAll(pinned);
+    total += chunk;
   }
+  return total;
+}
 
-  if (writeDisk(node, data, blocksNeeded, blocks) == -1) {
-    std::cerr << "Error al escribir datos en disco\n";
+long FS::write(const std::string& name, size_t offset, std::istream& in) {
+  durableScope durable(this);
+  std::shared_lock<std::shared_mutex> dir(this->dirLock);
+  int index = this->lookup(name);
+  if (index == -1) {
+    std::cout << "File \"" << name << "\" does not exist." << std::endl;
     return -1;
   }
 
-  this->sb.freeBlocks -= blocksNeeded;
-  saveChanges();
+  std::unique_lock<std::shared_mutex> file(this->inodeLock(index));
+  return this->writeFrom(index, offset, in);
+}
 
-  return 0;
+long FS::append(const std::string& name, std::istream& in) {
+  durableScope durable(this);
+  std::shared_lock<std::shared_mutex> dir(this->dirLock);
+  int index = this->lookup(name);
+  if (index == -1) {
+    std::cout << "File \"" << name << "\" does not exist." << std::endl;
+    return -1;
+  }
+
+  std::unique_lock<std::shared_mutex> file(this->inodeLock(index));
+  return this->writeFrom(index, this->sizeOf(index), in);
+}
+
+long FS::writeFrom(int index, size_t offset, std::istream& in) {
+  std::vector<char> buffer(STREAM_CHUNK_SIZE);
+  size_t total = 0;
+  while (in.read(buffer.data(), buffer.size()) || in.gcount() > 0) {
+    size_t chunk = in.gcount();
+    if (this->writeAt(index, offset + total, buffer.data(), chunk) == -1) {
+      std::lock_guard<std::mutex> meta(this->metaLock);
+      this->saveChanges();
+      return -1;
+    }
+    total += chunk;
+  }
+
+  //  los metadatos se guardan una sola vez al final del stream
+  std::lock_guard<std::mutex> meta(this->metaLock);
+  this->saveChanges();
+  return total;
 }
 
 int FS::deleteFile(const std::string& name) {
+  durableScope durable(this);
+  if (this->refuseWrite()) {
+    return -1;
+  }
+  //  con el directorio exclusivo nadie mas esta usando el archivo
+  std::unique_lock<std::shared_mutex> dir(this->dirLock);
+  std::lock_guard<std::mutex> meta(this->metaLock);
   int index = this->searchInode(name);
   if (index == -1) {
     std::cout << "The file \"" << name << "\" does not exist en the system." << std::endl;
     return -1;
   }
 
-  inode& node = this->inodesTable[index];
+  inode& node = this->inodeAt(index);
 
-  freeDataBlocks(node);
+  freeDataBlocks(index);
 
+  this->dirRemove(node.name);
+  this->nameIndex.erase(node.name);
   node.active = false;
+  node.nextFreeInode = this->sb.firstFreeInode;
+  this->sb.firstFreeInode = index;
+  this->markInodeDirty(index);
 
   this->sb.usedInodes--;
 
@@ -165,29 +631,53 @@ int FS::deleteFile(const std::string& name) {
 }
 
 void FS::printInode(const std::string& name) {
+  std::shared_lock<std::shared_mutex> dir(this->dirLock);
+  std::lock_guard<std::mutex> meta(this->metaLock);
   int index = searchInode(name);
   if (index == -1) {
     std::cout << "El archivo \"" << name << "\" no existe en el sistema." << std::endl;
+    return;
   }
 
   // Obtener el inode
-  const inode& node = inodesTable[index];
+  const inode& node = this->inodeAt(index);
 
   // Imprimir metadata
   std::cout << "=== inode del archivo: " << node.name << " ===" << std::endl;
   std::cout << "date: " << node.date << std::endl;
   std::cout << "inodeSize: " << node.inodeSize << " bytes" << std::endl;
 
-  // blocks directos
-  std::cout << "blocks directos: ";
-  for (int i = 0; i < DIRECT_BLOCK_SIZE; i++) {
-    if (node.directBlocks[i] != -1){
-      std::cout << node.directBlocks[i] << " ";
+  if (isInline(node)) {
+    std::cout << "datos dentro del inode" << std::endl;
+    return;
+  }
+
+  if (node.compressed) {
+    compressedHeader header;
+    memcpy(&header, node.inlineData, sizeof(compressedHeader));
+    std::cout << "comprimido: " << header.chunks << " chunks en " << header.indexOffset
+              << " bytes, mas " << (header.chunks + 1) * sizeof(uint32_t) << " del indice" << std::endl;
+  }
+
+  //  con dedup o con clones
+  this->loadBitMap();
+  int shared = 0;
+  for (const extent& e : getBlockMap(index)->extents) {
+    for (int b = e.start; b < e.start + e.length; b++) {
+      shared += this->refCounts[b] > 0;
     }
   }
+  if (node.deduped || shared > 0) {
+    std::cout << (node.deduped ? "dedup: " : "") << shared << " blocks compartidos con otros archivos" << std::endl;
+  }
+
+  // extents como inicio+cantidad
+  std::cout << "extents: ";
+  for (const extent& e : getBlockMap(index)->extents) {
+    std::cout << e.start << "+" << e.length << " ";
+  }
   std::cout << std::endl;
 
-  // blocks indirectos
   std::cout << "blocks indirectos: ";
   for (int i = 0; i < INDIRECT_BLOCK_SIZE; i++) {
     if (node.indirectBlocks[i] != -1){
@@ -198,63 +688,45 @@ void FS::printInode(const std::string& name) {
 }
 
 void FS::printSB() {
+  std::lock_guard<std::mutex> meta(this->metaLock);
   std::cout << "superBlock:" << std::endl;
   std::cout << "Total blocks: " << sb.TotalBlocks << std::endl;
   std::cout << "inodeSize bloque: " << sb.blockSize << std::endl;
   std::cout << "blocks libres: " << sb.freeBlocks << std::endl;
   std::cout << "Maximo inodos: " << sb.maxInodes << std::endl;
   std::cout << "Inodos usados: " << sb.usedInodes << std::endl;
+  std::cout << "Checksums: CRC32C " << (Crc32c::hardware() ? "con SSE4.2" : "por tablas") << std::endl;
+  std::cout << "Cache: " << this->cacheHits() << " aciertos, " << this->cacheMisses() << " fallos" << std::endl;
+}
+
+uint64_t FS::cacheHits() const {
+  return this->disk->hits();
+}
+
+uint64_t FS::cacheMisses() const {
+  return this->disk->misses();
 }
 
 int FS::printInodeContent(std::string name) {
-  int index = this->searchInode(name);
+  std::shared_lock<std::shared_mutex> dir(this->dirLock);
+  int index = this->lookup(name);
   if (index == -1) {
     std::cout << "El archivo \"" << name << "\" no existe en el sistema." << std::endl;
     return 0;
   }
 
-  const inode& node = this->inodesTable[index];
-  if(node.inodeSize == 0) {
+  std::shared_lock<std::shared_mutex> file(this->inodeLock(index));
+  size_t fileSize = this->sizeOf(index);
+  if(fileSize == 0) {
     std::cout << "El archivo \"" << name << "\" no contiene datos." << std::endl;
     return 0;
   }
 
-  int tableBlocks = (sizeTablaBytes + BLOCK_SIZE - 1) / BLOCK_SIZE;
-  int offsetInicioDatos = (2 + tableBlocks) * BLOCK_SIZE;
-
-  std::cout << node.name << " :"<< std::endl;
-
-  size_t bytesLeidos = 0;
-  std::vector<char> buffer(BLOCK_SIZE);
-
-  //  blocks directos
-  for (int i = 0; i < DIRECT_BLOCK_SIZE && bytesLeidos < node.inodeSize; i++) {
-
-    if (node.directBlocks[i] == -1){
-      continue;
-    }
-
-    this->diskFile.seekg(offsetInicioDatos + node.directBlocks[i] * BLOCK_SIZE);
-    this->diskFile.read(buffer.data(), BLOCK_SIZE);
-
-    size_t bytesRestantes = std::min((size_t)BLOCK_SIZE, node.inodeSize - bytesLeidos);
-    std::cout.write(buffer.data(), bytesRestantes);
-    bytesLeidos += bytesRestantes;
+  std::cout << name << " :"<< std::endl;
 
-  }
-
-  //  blocks indirectos
-  for (int i = 0; i < INDIRECT_BLOCK_SIZE && bytesLeidos < node.inodeSize; i++) {
-    if (node.indirectBlocks[i] == -1){
-      continue;
-    }
-
-    this->diskFile.seekg(offsetInicioDatos + node.indirectBlocks[i] * BLOCK_SIZE);
-    this->diskFile.read(buffer.data(), BLOCK_SIZE);
-
-    size_t porLeer = std::min((size_t)BLOCK_SIZE, node.inodeSize - bytesLeidos);
-    std::cout.write(buffer.data(), porLeer);
-    bytesLeidos += porLeer;
+  if (this->readTo(index, 0, fileSize, std::cout) == -1) {
+    std::cout << "No se pudo leer del disco\n";
+    return -1;
   }
 
   std::cout << std::endl;
@@ -262,16 +734,44 @@ int FS::printInodeContent(std::string name) {
 }
 
 int FS::changeName(std::string name,std::string newName) {
+  durableScope durable(this);
+  if (this->refuseWrite()) {
+    return -1;
+  }
+  if (newName.empty() || newName.size() >= MAX_NAME_LENGTH) {
+    std::cout << "Nombre de archivo invalido" << std::endl;
+    return -1;
+  }
+  std::unique_lock<std::shared_mutex> dir(this->dirLock);
+  std::lock_guard<std::mutex> meta(this->metaLock);
   int index = this->searchInode(name);
   if (index == -1) {
     std::cout << "File \"" << name << "\" does not exist." << std::endl;
     return -1;
   }
 
-  inode& node = inodesTable[index];
+  if (this->searchInode(newName) != -1) {
+    std::cout << "File \"" << newName << "\" already exists." << std::endl;
+    return -1;
+  }
+
+  inode& node = this->inodeAt(index);
 
-  strncpy(node.name, newName.c_str(), MAX_NAME_LENGTH - 1);
-  node.name[MAX_NAME_LENGTH - 1] = '\0';
+  //  primero la entrada nueva: si no hay bloques para partir un nodo del
+  //  directorio, el archivo sigue con su nombre anterior. Sacar la vieja
+  //  despues nunca necesita bloques
+  char newNameBuffer[MAX_NAME_LENGTH] = {0};
+  strncpy(newNameBuffer, newName.c_str(), MAX_NAME_LENGTH - 1);
+  if (this->dirInsert(newNameBuffer, index) == -1) {
+    std::cout << "Insufficient space to rename this file" << std::endl;
+    this->saveChanges();
+    return -1;
+  }
+  this->dirRemove(node.name);
+  this->nameIndex.erase(node.name);
+  memcpy(node.name, newNameBuffer, MAX_NAME_LENGTH);
+  this->markInodeDirty(index);
+  this->nameIndex.insert(node.name, index);
 
   this->saveChanges();
 
@@ -280,6 +780,8 @@ int FS::changeName(std::string name,std::string newName) {
 }
 
 void FS::fileList() {
+  std::shared_lock<std::shared_mutex> dir(this->dirLock);
+  std::lock_guard<std::mutex> meta(this->metaLock);
   std::cout << "=== Lista de Archivos ===" << std::endl;
     std::cout << std::left << std::setw(20) << "name" 
               << std::setw(12) << "date" 
@@ -287,119 +789,684 @@ void FS::fileList() {
               << std::setw(8) << "Estado" << std::endl;
     std::cout << std::string(50, '-') << std::endl;
     
-    bool hayArchivos = false;
-    for (int i = 0; i < sb.maxInodes; i++) {
-        if (inodesTable[i].active) {
-            hayArchivos = true;
-            std::cout << std::left << std::setw(20) << inodesTable[i].name
-                      << std::setw(12) << inodesTable[i].date
-                      << std::setw(10) << inodesTable[i].inodeSize
-                      << std::setw(8) << "Activo" << std::endl;
-        }
-    }
-    
-    if (!hayArchivos) {
+    if (sb.usedInodes == 0) {
         std::cout << "No hay archivos en el sistema." << std::endl;
+        return;
     }
+
+    //  el directorio se recorre en orden alfabetico
+    this->dirForEach(sb.dirRoot, [](void* context, const dirEntry& entry) {
+        const inode& node = static_cast<FS*>(context)->inodeAt(entry.inodeNumber);
+        std::cout << std::left << std::setw(20) << node.name
+                  << std::setw(12) << node.date
+                  << std::setw(10) << node.inodeSize
+                  << std::setw(8) << "Activo" << std::endl;
+    }, this);
+}
+
+int FS::lookup(const std::string& name) {
+  std::lock_guard<std::mutex> meta(this->metaLock);
+  return this->searchInode(name);
+}
+
+size_t FS::sizeOf(int index) {
+  std::lock_guard<std::mutex> meta(this->metaLock);
+  return this->inodeAt(index).inodeSize;
+}
+
+std::shared_mutex& FS::inodeLock(int number) {
+  return this->inodeLocks[number % INODE_LOCK_STRIPES];
 }
+
 int FS::searchInode(const std::string &name)
 {
-  for (int i = 0; i < sb.usedInodes; i++) {
-    if (std::string (this->inodesTable[i].name) == name) {
-      return i;
+  int index = this->nameIndex.find(name);
+  if (index == -1) {
+    //  no esta en memoria: buscar en el directorio y recordar el resultado
+    index = this->dirLookup(name);
+    if (index != -1) {
+      this->nameIndex.insert(this->inodeAt(index).name, index);
     }
   }
-  return -1;
+  return index;
 }
 
-std::vector<int> FS::findFreeBlock(int cantidad) {
-  int encontrados = 0;
-  std::vector<int> blocks;
-  for (int i = 0; i < this->sb.TotalBlocks; i++) {
-    if (bitMap[i] == 0) {
-      bitMap[i] = 1;
-      encontrados++;
-      blocks.push_back(i);
-      if (encontrados == cantidad){
-        return blocks;
-      }
+const char* FS::inodeName(const void* fs, int index) {
+  //  nameIndex solo guarda inodos ya leidos
+  const FS* self = static_cast<const FS*>(fs);
+  return self->inodesTable[index / self->inodesPerBlock][index % self->inodesPerBlock].name;
+}
+
+int FS::allocateInode() {
+  if (this->sb.firstFreeInode == -1 && this->growInodeTable() == -1) {
+    return -1;
+  }
+
+  int index = this->sb.firstFreeInode;
+  this->sb.firstFreeInode = this->inodeAt(index).nextFreeInode;
+  return index;
+}
+
+int FS::allocateOrphan(bool compress, bool dedup) {
+  int index = this->allocateInode();
+  if (index == -1) {
+    return -1;
+  }
+
+  //  sin nombre ni entrada en el directorio; si el sistema se cae antes de
+  //  releaseOrphan, mount lo encuentra en la lista y devuelve sus bloques
+  inode& node = this->inodeAt(index);
+  node = inode{};
+  node.active = true;
+  node.compressed = compress;
+  node.deduped = dedup;
+  node.nextFreeInode = this->sb.orphanInodes;
+  resetExtents(node);
+  this->sb.orphanInodes = index;
+  this->markInodeDirty(index);
+  return index;
+}
+
+void FS::releaseOrphan(int number) {
+  int* link = &this->sb.orphanInodes;
+  while (*link != number) {
+    link = &this->inodeAt(*link).nextFreeInode;
+  }
+  inode& node = this->inodeAt(number);
+  *link = node.nextFreeInode;
+
+  this->freeDataBlocks(number);
+  node.active = false;
+  node.inodeSize = 0;
+  node.nextFreeInode = this->sb.firstFreeInode;
+  this->sb.firstFreeInode = number;
+  this->markInodeDirty(number);
+}
+
+int FS::growInodeTable() {
+  //  cada tramo duplica la tabla; si no hay un hueco de ese tamano se prueba con la mitad
+  int tableBlocks = this->sb.inodeTable.inodeSize / BLOCK_SIZE;
+  std::vector<extent> tramo;
+  for (int chunk = std::max(INODE_CHUNK_BLOCKS, tableBlocks); chunk >= 1 && tramo.empty(); chunk /= 2) {
+    try {
+      tramo = this->findFreeBlock(chunk, 1);
+    } catch (const std::runtime_error&) {
     }
   }
+  if (tramo.empty()) {
+    return -1;
+  }
 
-  throw std::runtime_error("FS::findFreeBlock failed");
+  if (this->appendExtent(INODE_TABLE_NUMBER, tramo[0]) == -1) {
+    for (int b = 0; b < tramo[0].length; b++) {
+      this->releaseBlock(tramo[0].start + b);
+    }
+    return -1;
+  }
+  this->sb.inodeTable.inodeSize += tramo[0].length * BLOCK_SIZE;
+
+  //  los inodos nuevos se encadenan a la lista de libres en orden ascendente
+  int first = this->sb.maxInodes;
+  this->sb.maxInodes += tramo[0].length * this->inodesPerBlock;
+  this->inodesTable.resize(this->sb.maxInodes / this->inodesPerBlock, std::vector<inode>(this->inodesPerBlock));
+  for (int i = this->sb.maxInodes - 1; i >= first; i--) {
+    inode& node = this->inodeAt(i);
+    node = inode{};
+    node.nextFreeInode = this->sb.firstFreeInode;
+    this->sb.firstFreeInode = i;
+    this->markInodeDirty(i);
+  }
+  return 0;
 }
 
-int FS::writeDisk(inode& node, const std::string& data, int blocksNeeded, std::vector<int>& blocks) {
+void FS::countGroupFree() {
+  int groups = (this->sb.TotalBlocks + BLOCKS_PER_GROUP - 1) / BLOCKS_PER_GROUP;
+  this->groupFree.assign(groups, 0);
+  //  los grupos son de palabras enteras y el relleno del final esta ocupado
+  const uint64_t* words = this->bitMap.data();
+  size_t wordCount = (this->bitMap.bits() + 63) / 64;
+  for (size_t w = 0; w < wordCount; w++) {
+    this->groupFree[w * 64 / BLOCKS_PER_GROUP] += 64 - __builtin_popcountll(words[w]);
+  }
+}
+
+std::vector<extent> FS::findFreeBlock(int cantidad, int maxExtents, int goal) {
+  this->loadBitMap();
+  if (cantidad > this->sb.freeBlocks) {
+    throw std::runtime_error("FS::findFreeBlock failed");
+  }
+  if (cantidad == 0) {
+    return std::vector<extent>();
+  }
+  if (goal < 0 || goal >= this->sb.TotalBlocks) {
+    goal = this->sb.firstFreeBlock < this->sb.TotalBlocks ? this->sb.firstFreeBlock : 0;
+  }
+
+  //  tomar los huecos mas grandes primero hasta juntar cantidad bloques
+  std::vector<extent> huecos;
+  std::vector<extent> extents;
+  auto elegir = [&]() {
+    std::vector<extent> orden = huecos;
+    std::stable_sort(orden.begin(), orden.end(),
+        [](const extent& a, const extent& b) { return a.length > b.length; });
+    extents.clear();
+    int encontrados = 0;
+    for (size_t i = 0; i < orden.size() && encontrados < cantidad; i++) {
+      extent e = orden[i];
+      e.length = std::min(e.length, cantidad - encontrados);
+      extents.push_back(e);
+      encontrados += e.length;
+    }
+    return encontrados == cantidad && (int)extents.size() <= maxExtents;
+  };
+
+  //  recorrer los grupos desde el de goal, saltando sin mirar el bitmap los que
+  //  estan llenos: el grupo de goal se recorre desde goal y al final de la vuelta
+  //  desde su inicio hasta goal. Si un hueco alcanza para todo se usa ese; si no,
+  //  se deja de buscar en cuanto los grupos ya vistos alcanzan
+  int groups = this->groupFree.size();
+  int first = goal / BLOCKS_PER_GROUP;
+  int libres = 0;
+  long visto = 0;  //  hasta aqui ya se registraron los huecos
+  bool listo = false;
+  for (int i = 0; i <= groups && !listo; i++) {
+    int g = (first + i) % groups;
+    if (i > 0 && g == 0) {
+      visto = 0;
+    }
+    if (this->groupFree[g] == 0) {
+      continue;
+    }
+    long from = i == 0 ? goal : (long)g * BLOCKS_PER_GROUP;
+    long to = i == groups ? goal : std::min((long)(g + 1) * BLOCKS_PER_GROUP, (long)this->sb.TotalBlocks);
+    //  despues de dar la vuelta los huecos no pueden seguir dentro de lo ya recorrido
+    long limite = first + i >= groups ? goal : this->sb.TotalBlocks;
+
+    long block = std::max(from, visto);
+    while (block < to && (block = bitMap.findFirstZero(block)) != -1 && block < to) {
+      int length = bitMap.zeroRunLength(block, std::min((long)cantidad, limite - block));
+      if (length == cantidad) {
+        huecos.assign(1, extent{(int)block, length});
+        listo = true;
+        break;
+      }
+      huecos.push_back(extent{(int)block, length});
+      libres += length;
+      block += length;
+    }
+    visto = block == -1 ? this->sb.TotalBlocks : std::max(block, to);
+    if (!listo && libres >= cantidad && elegir()) {
+      break;
+    }
+  }
 
-  for (int i = 0; i < blocksNeeded; i++) {
-    int indiceBloque = blocks[i];
-    size_t offset = i * this->sb.blockSize;
+  if (!elegir()) {
+    throw std::runtime_error("FS::findFreeBlock failed");
+  }
 
-    size_t bytesRestantes = std::min((size_t)sb.blockSize, data.size() - offset);
+  //  dejar los extents en orden de disco para que la lectura avance hacia adelante
+  std::sort(extents.begin(), extents.end(),
+      [](const extent& a, const extent& b) { return a.start < b.start; });
 
-    std::vector<char> buffer(sb.blockSize, 0);
+  for (const extent& e : extents) {
+    this->claimExtent(e);
+  }
+  return extents;
+}
 
-    if(bytesRestantes > 0) {
-      memcpy(buffer.data(), data.data() + offset, bytesRestantes);
+void FS::claimExtent(const extent& e) {
+  this->loadBitMap();
+  for (int b = 0; b < e.length; b++) {
+    bitMap.set(e.start + b);
+    this->groupFree[(e.start + b) / BLOCKS_PER_GROUP]--;
+    if (!this->releasedBlocks.count(e.start + b)) {
+      this->freshBlocks.insert(e.start + b);
     }
+  }
+  this->sb.freeBlocks -= e.length;
+
+  if (e.start == this->sb.firstFreeBlock) {
+    long siguiente = bitMap.findFirstZero(this->sb.firstFreeBlock);
+    this->sb.firstFreeBlock = siguiente == -1 ? this->sb.TotalBlocks : siguiente;
+  }
+}
 
-    int offsetInicioDatos = (2 + tableBlocks) * BLOCK_SIZE;
-    this->diskFile.seekp(offsetInicioDatos + indiceBloque * this->sb.blockSize);
-    this->diskFile.write(buffer.data(), this->sb.blockSize);
+int FS::growFile(int number, int blocks) {
+  int faltan = blocks;
+  this->loadBitMap();
+
+  //  si los bloques que siguen al ultimo extent estan libres el archivo sigue contiguo
+  std::shared_ptr<const blockMap> map = this->getBlockMap(number);
+  if (!map->extents.empty()) {
+    int siguiente = map->extents.back().start + map->extents.back().length;
+    int libres = siguiente < this->sb.TotalBlocks ? bitMap.zeroRunLength(siguiente, faltan) : 0;
+    if (libres > 0) {
+      extent e = {siguiente, libres};
+      this->claimExtent(e);
+      if (this->appendExtent(number, e) == -1) {
+        for (int b = 0; b < e.length; b++) {
+          this->releaseBlock(e.start + b);
+        }
+        return -1;
+      }
+      faltan -= libres;
+    }
+  }
 
+  if (faltan == 0) {
+    return 0;
+  }
+
+  //  seguir despues del ultimo bloque del archivo o, si todavia no tiene, en el
+  //  grupo del inode: cada inode tiene su grupo como si la tabla estuviera
+  //  repartida entre ellos, asi archivos que crecen a la vez no se intercalan
+  int goal = !map->extents.empty() ? map->extents.back().start + map->extents.back().length
+      : number >= 0 ? (number % (int)this->groupFree.size()) * BLOCKS_PER_GROUP : -1;
+
+  std::vector<extent> extents;
+  try {
+    extents = this->findFreeBlock(faltan, MAX_EXTENTS - this->inodeAt(number).extentCount, goal);
+  } catch (const std::runtime_error&) {
+    return -1;
+  }
+
+  for (size_t i = 0; i < extents.size(); i++) {
+    if (this->appendExtent(number, extents[i]) == -1) {
+      for (size_t j = i; j < extents.size(); j++) {
+        for (int b = 0; b < extents[j].length; b++) {
+          this->releaseBlock(extents[j].start + b);
+        }
+      }
+      return -1;
+    }
+  }
+  return 0;
+}
+
+int FS::writeDisk(const blockMap& map, size_t offset, const char* data, size_t size) {
+  if (size == 0) {
+    return 0;
+  }
+  std::vector<char> zeros;
+  if (data == nullptr) {
+    zeros.assign(size, 0);
+    data = zeros.data();
+  }
+  size_t blockSize = this->sb.blockSize;
+  size_t end = offset + size;
+  size_t first = offset / blockSize;
+  size_t last = (end - 1) / blockSize;
+
+  size_t i = 0;
+  auto physical = [&](size_t logical) -> long {
+    while (i < map.extents.size() && (size_t)(map.firstLogical[i] + map.extents[i].length) <= logical) {
+      i++;
+    }
+    if (i == map.extents.size() || (size_t)map.firstLogical[i] > logical) {
+      return -1;
+    }
+    return map.extents[i].start + (logical - map.firstLogical[i]);
+  };
+
+  //  los bloques de los bordes que no se escriben completos se leen y se
+  //  completan antes: cada bloque se escribe entero y su checksum sale de lo
+  //  que se escribe, sin volver a leerlo
+  std::vector<char> head;
+  std::vector<char> tail;
+  if (offset % blockSize != 0 || (first == last && end % blockSize != 0)) {
+    long p = physical(first);
+    head.resize(blockSize);
+    if (p == -1 || this->disk->read((size_t)p * blockSize, head.data(), blockSize) == -1) {
+      return -1;
+    }
+    memcpy(head.data() + offset % blockSize, data, std::min(end, (first + 1) * blockSize) - offset);
+  }
+  if (last != first && end % blockSize != 0) {
+    long p = physical(last);
+    tail.resize(blockSize);
+    if (p == -1 || this->disk->read((size_t)p * blockSize, tail.data(), blockSize) == -1) {
+      return -1;
+    }
+    memcpy(tail.data(), data + (last * blockSize - offset), end - last * blockSize);
+  }
 
-    if(!diskFile) {
-      std::cout << "No se pudo escribir en el disco\n";
+  //  bloques seguidos en disco y en memoria van en la misma escritura, y todas
+  //  al disco en un solo lote
+  std::vector<diskWrite> writes;
+  std::vector<std::pair<int, uint32_t>> sums;
+  i = 0;
+  for (size_t b = first; b <= last; b++) {
+    long p = physical(b);
+    if (p == -1) {
       return -1;
     }
+    const char* source = (b == first && !head.empty()) ? head.data()
+                       : (b == last && !tail.empty()) ? tail.data()
+                       : data + (b * blockSize - offset);
+    sums.push_back({(int)p, Crc32c::compute(source, blockSize)});
+
+    if (!writes.empty() && writes.back().offset + writes.back().size == (size_t)p * blockSize &&
+        static_cast<const char*>(writes.back().buffer) + writes.back().size == source) {
+      writes.back().size += blockSize;
+    } else {
+      writes.push_back({(size_t)p * blockSize, source, blockSize});
+    }
+  }
+
+  if (this->disk->writeBatch(writes) == -1) {
+    std::cout << "No se pudo escribir en el disco\n";
+    return -1;
+  }
+  this->updateChecksums(sums);
+  return 0;
+}
+
+int FS::readDisk(int number, size_t offset, char* data, size_t size) {
+  bool compressed = false;
+  if (number != INODE_TABLE_NUMBER) {
+    std::lock_guard<std::mutex> meta(this->metaLock);
+    const inode& node = this->inodeAt(number);
+    if (isInline(node)) {
+      if (offset + size > INLINE_DATA_SIZE) {
+        return -1;
+      }
+      memcpy(data, node.inlineData + offset, size);
+      return 0;
+    }
+    compressed = node.compressed;
+  }
+  if (compressed) {
+    return this->readCompressed(number, offset, data, size);
+  }
+  return this->readStream(number, offset, data, size);
+}
+
+int FS::readStream(int number, size_t offset, char* data, size_t size) {
+  std::unique_lock<std::mutex> meta(this->metaLock);
+
+  //  los bloques se leen sin metaLock; el mapa sigue vivo aunque salga de la cache
+  std::shared_ptr<const blockMap> map = this->getBlockMap(number);
+  std::vector<extent> ahead;
+  if (number != INODE_TABLE_NUMBER && size > 0) {
+    ahead = this->readAhead(number, offset, size, *map);
+  }
+  meta.unlock();
+  size_t end = offset + size;
+
+  //  lo de adelante se pide primero, asi se lee mientras se espera lo pedido
+  for (const extent& e : ahead) {
+    this->disk->prefetch((size_t)e.start * this->sb.blockSize, (size_t)e.length * this->sb.blockSize);
   }
 
-  this->diskFile.flush();
+  std::vector<diskRead> reads;
+  for (size_t i = 0; i < map->extents.size() && offset < end; i++) {
+    size_t extentStart = (size_t)map->firstLogical[i] * this->sb.blockSize;
+    size_t extentEnd = extentStart + (size_t)map->extents[i].length * this->sb.blockSize;
+    if (extentEnd <= offset) {
+      continue;
+    }
 
+    size_t porLeer = std::min(extentEnd, end) - offset;
+    size_t diskOffset = (size_t)map->extents[i].start * this->sb.blockSize + (offset - extentStart);
+    reads.push_back({diskOffset, data, porLeer});
+    offset += porLeer;
+    data += porLeer;
+  }
+  if (offset != end) {
+    return -1;
+  }
+
+  //  con varios extents las lecturas van juntas y el motor las hace en paralelo
+  if (!reads.empty() && this->disk->readBatch(reads) == -1) {
+    return -1;
+  }
   return 0;
 }
 
-void FS::saveChanges() {
-  //  escribir super bloque en bloque 0
-  this->diskFile.seekp(0 * BLOCK_SIZE);
-  this->diskFile.write(reinterpret_cast<char*>(&sb), sizeof(this->sb));
-  this->diskFile.flush();
-  //  escribir bitMap en bloque 1
-  this->diskFile.seekp(1 * BLOCK_SIZE);
-  this->diskFile.write(reinterpret_cast<char*>(bitMap.data()), sizeof(int) * bitMap.size());
-  this->diskFile.flush();
+std::vector<extent> FS::readAhead(int number, size_t offset, size_t size, const blockMap& map) {
+  int first = offset / this->sb.blockSize;
+  int last = (offset + size - 1) / this->sb.blockSize;
+  int fileBlocks = ((size_t)this->inodeAt(number).inodeSize + this->sb.blockSize - 1) / this->sb.blockSize;
+
+  //  un archivo que no se leyo empieza con nextBlock 0: leerlo desde el
+  //  principio ya cuenta como secuencial. Volver a leer el ultimo bloque
+  //  tambien, porque las lecturas no siempre terminan en un borde de bloque
+  readAheadWindow& ra = this->readAheads[number];
+  if (first == ra.nextBlock || first == ra.nextBlock - 1) {
+    //  la ventana se duplica y nunca es mas chica que la lectura misma
+    ra.window = std::min(std::max({2 * ra.window, last - first + 1, READAHEAD_MIN_BLOCKS}), READAHEAD_MAX_BLOCKS);
+  } else {
+    ra.window = 0;
+    ra.aheadUntil = 0;
+  }
+  ra.nextBlock = last + 1;
+
+  //  se vuelve a pedir cuando queda menos de media ventana pedida por delante,
+  //  asi la lectura siguiente no alcanza al prefetch
+  int desde = std::max(ra.aheadUntil, last + 1);
+  int hasta = std::min(last + 1 + ra.window, fileBlocks);
+  if (ra.window == 0 || ra.aheadUntil - (last + 1) >= ra.window / 2 || desde >= hasta) {
+    return {};
+  }
+  ra.aheadUntil = hasta;
+
+  std::vector<extent> ahead;
+  for (size_t i = 0; i < map.extents.size(); i++) {
+    int extentStart = map.firstLogical[i];
+    int extentEnd = extentStart + map.extents[i].length;
+    if (extentEnd <= desde || extentStart >= hasta) {
+      continue;
+    }
+    int from = std::max(desde, extentStart);
+    int to = std::min(hasta, extentEnd);
+    ahead.push_back({map.extents[i].start + (from - extentStart), to - from});
+  }
+  return ahead;
+}
 
-  //  escribir la tabla de inodos en bloque 2 en adelante
-  this->diskFile.seekp(2 * BLOCK_SIZE);
-  this->diskFile.write(reinterpret_cast<char*>(inodesTable.data()), this->sizeTablaBytes);
-  this->diskFile.flush();
+bool FS::isInline(const inode& node) {
+  return node.extentCount == 0;
 }
 
-int FS::freeDataBlocks(const inode& node){
-  //  free direct blocks
-  for (int i = 0; i < DIRECT_BLOCK_SIZE; i++) {
-    if (node.directBlocks[i] == 0) {
-      this->bitMap[node.directBlocks[i]] = 0;
-      this->sb.freeBlocks++;
+long FS::writeAt(int index, size_t offset, const char* data, size_t size) {
+  size_t end = offset + size;
+  if (size == 0) {
+    return 0;
+  }
+  if (this->refuseWrite()) {
+    return -1;
+  }
+
+  std::unique_lock<std::mutex> meta(this->metaLock);
+  inode& node = this->inodeAt(index);
+  size_t oldSize = node.inodeSize;
+
+  //  un archivo comprimido sigue inline mientras quepa, como cualquier otro
+  if (node.compressed && (!isInline(node) || end > INLINE_DATA_SIZE)) {
+    meta.unlock();
+    return this->writeCompressed(index, offset, data, size);
+  }
+  if (node.deduped && (!isInline(node) || end > INLINE_DATA_SIZE)) {
+    meta.unlock();
+    return this->writeDeduped(index, offset, data, size);
+  }
+
+  if (isInline(node)) {
+    if (end <= INLINE_DATA_SIZE) {
+      //  todo queda en el inode: ningun bloque de datos que leer ni escribir;
+      //  los bytes despues de inodeSize siempre estan en cero
+      memcpy(node.inlineData + offset, data, size);
+      node.inodeSize = std::max(oldSize, end);
+      this->markInodeDirty(index);
+      return size;
+    }
+
+    //  el archivo ya no cabe: lo que tenia pasa al primer bloque y sigue como cualquier otro
+    if (oldSize > 0) {
+      int neededBlocks = (end + this->sb.blockSize - 1) / this->sb.blockSize;
+      if (neededBlocks > this->sb.freeBlocks || this->growFile(index, neededBlocks) == -1) {
+        std::cout << "Insufficient space to store this file" << std::endl;
+        return -1;
+      }
+      char contenido[INLINE_DATA_SIZE];
+      memcpy(contenido, node.inlineData, oldSize);
+      memset(node.inlineData, 0, INLINE_DATA_SIZE);
+      this->markInodeDirty(index);
+      //  todavia con metaLock: ningun commit ve el inode sin inlineData antes
+      //  de que su contenido este en el bloque
+      if (this->writeDisk(*this->getBlockMap(index), 0, contenido, oldSize) == -1) {
+        return -1;
+      }
     }
   }
 
-  //  free indirect blocks  
-  for (int i = 0; i < INDIRECT_BLOCK_SIZE; i++) {
-    if (node.indirectBlocks[i] == 0) {
-      this->bitMap[node.indirectBlocks[i]] = 0;
-      this->sb.freeBlocks++;
+  //  pedir solo los bloques que faltan despues del ultimo que ya tiene el archivo
+  std::shared_ptr<const blockMap> map = this->getBlockMap(index);
+  int ownedBlocks = map->extents.empty() ? 0 : map->firstLogical.back() + map->extents.back().length;
+  int neededBlocks = (end + this->sb.blockSize - 1) / this->sb.blockSize;
+  if (neededBlocks > ownedBlocks) {
+    if (neededBlocks - ownedBlocks > this->sb.freeBlocks || this->growFile(index, neededBlocks - ownedBlocks) == -1) {
+      std::cout << "Insufficient space to store this file" << std::endl;
+      return -1;
     }
+    map = this->getBlockMap(index);
+  }
+
+  //  los bloques que ya tenian contenido se reescriben en su lugar, salvo
+  //  los compartidos con un clon y los de tramos sin marca durable
+  size_t desde = std::min(offset, oldSize);
+  std::unordered_set<int> unmarked;
+  if (this->markOverwrites(*map, desde, end - desde, unmarked) == -1 ||
+      this->breakSharing(index, desde, end - desde, meta, unmarked) == -1) {
+    return -1;
+  }
+  map = this->getBlockMap(index);
+
+  //  los datos se copian sin metaLock, asi otros archivos siguen en paralelo;
+  //  inodeSize cambia recien despues y nadie lee los bloques nuevos antes
+  meta.unlock();
+
+  //  un hueco entre el final anterior y offset se llena con ceros
+  if (offset > oldSize && this->writeDisk(*map, oldSize, nullptr, offset - oldSize) == -1) {
+    return -1;
+  }
+  if (this->writeDisk(*map, offset, data, size) == -1) {
+    return -1;
+  }
+
+  if (end > oldSize) {
+    meta.lock();
+    this->inodeAt(index).inodeSize = end;
+    this->markInodeDirty(index);
+  }
+  return size;
+}
+
+void FS::markInodeDirty(int number) {
+  //  el inode de la tabla vive en el superBlock
+  if (number != INODE_TABLE_NUMBER) {
+    this->dirtyInodeBlocks.insert(number / this->inodesPerBlock);
+  }
+}
+
+int FS::readMeta(int block, size_t offset, void* buffer, size_t size) {
+  auto staged = this->dirtyMeta.find(block);
+  if (staged != this->dirtyMeta.end()) {
+    memcpy(buffer, staged->second.data() + offset, size);
+    return 0;
+  }
+  //  un commit que escribe sin metaLock puede no haber llegado a este bloque
+  staged = this->committingMeta.find(block);
+  if (staged != this->committingMeta.end()) {
+    memcpy(buffer, staged->second.data() + offset, size);
+    return 0;
   }
+
+  //  los metadatos se copian directo del frame de la cache
+  const char* frame = this->disk->pin(block);
+  if (frame == nullptr) {
+    return this->disk->read((size_t)block * BLOCK_SIZE + offset, buffer, size);
+  }
+  memcpy(buffer, frame + offset, size);
+  this->disk->unpin(block);
+  return 0;
+}
+
+int FS::writeMeta(int block, size_t offset, const void* buffer, size_t size) {
+  auto staged = this->dirtyMeta.find(block);
+  if (staged == this->dirtyMeta.end()) {
+    std::vector<char> image(BLOCK_SIZE);
+    auto committing = this->committingMeta.find(block);
+    if (committing != this->committingMeta.end()) {
+      image = committing->second;
+    } else if (!(offset == 0 && size == BLOCK_SIZE) &&
+               this->disk->read((size_t)block * BLOCK_SIZE, image.data(), BLOCK_SIZE) == -1) {
+      return -1;
+    }
+    staged = this->dirtyMeta.emplace(block, std::move(image)).first;
+  }
+  memcpy(staged->second.data() + offset, buffer, size);
   return 0;
 }
 
+void FS::discardFreedBlocks() {
+  std::sort(this->pendingDiscards.begin(), this->pendingDiscards.end());
+  size_t i = 0;
+  while (i < this->pendingDiscards.size()) {
+    //  un bloque que se volvio a asignar en la misma transaccion ya tiene datos nuevos
+    int start = this->pendingDiscards[i++];
+    if (this->bitMap.test(start)) {
+      continue;
+    }
+    int end = start + 1;
+    while (i < this->pendingDiscards.size() && this->pendingDiscards[i] <= end) {
+      if (this->pendingDiscards[i] == end) {
+        if (this->bitMap.test(end)) {
+          break;
+        }
+        end++;
+      }
+      i++;
+    }
+    this->disk->discard((size_t)start * BLOCK_SIZE, (size_t)(end - start) * BLOCK_SIZE);
+  }
+  this->pendingDiscards.clear();
+}
+
+void FS::releaseBlock(int block) {
+  //  un bloque compartido solo pierde un dueno, y uno fijo no se reusa hasta el release
+  this->loadBitMap();
+  if (this->unshareBlock(block) || this->deferRelease(block)) {
+    return;
+  }
+
+  //  un bloque de metadatos liberado no se debe escribir despues sobre su nuevo dueno,
+  //  ni desde dirtyMeta ni al rehacer una transaccion vieja del journal
+  this->dirtyMeta.erase(block);
+  if (this->journaledBlocks.count(block)) {
+    this->revokedBlocks.push_back(block);
+  }
+  this->blocksFreed = true;
+  if (!this->freshBlocks.erase(block)) {
+    this->releasedBlocks.insert(block);
+  }
+  this->pendingDiscards.push_back(block);
+  this->forgetChecksum(block);
+  this->forgetHash(block);
+  this->bitMap.clear(block);
+  this->groupFree[block / BLOCKS_PER_GROUP]++;
+  this->sb.freeBlocks++;
+  if (block < this->sb.firstFreeBlock) {
+    this->sb.firstFreeBlock = block;
+  }
+}
+
 std::string FS::getActualDate() {
   time_t now = time(0);
   tm* ltm = localtime(&now);
     
-  char buffer[MAX_DATE_LENGTH];
-  snprintf(buffer, MAX_DATE_LENGTH, "%04d-%02d-%02d", 
+  char buffer[32];
+  snprintf(buffer, sizeof(buffer), "%04d-%02d-%02d", 
           1900 + ltm->tm_year, 1 + ltm->tm_mon, ltm->tm_mday);
   return std::string(buffer);
 }
@@ -0,0 +1,334 @@
+#include "../include/FS.h"
+
+//  los extents de un archivo se numeran en orden: los EXTENT_COUNT primeros
+//  viven en el inode, los EXTENTS_PER_BLOCK siguientes en el bloque indirecto
+//  simple y el resto en bloques de extents apuntados por el indirecto doble
+
+inode& FS::inodeAt(int number) {
+  if (number == INODE_TABLE_NUMBER) {
+    return this->sb.inodeTable;
+  }
+  std::vector<inode>& block = this->inodesTable[number / this->inodesPerBlock];
+  if (block.empty()) {
+    this->loadInodeBlock(number / this->inodesPerBlock);
+  }
+  return block[number % this->inodesPerBlock];
+}
+
+void FS::resetExtents(inode& node) {
+  node.extentCount = 0;
+  for (int i = 0; i < EXTENT_COUNT; i++) {
+    node.extents[i].start = -1;
+    node.extents[i].length = 0;
+  }
+  for (int i = 0; i < INDIRECT_BLOCK_SIZE; i++) {
+    node.indirectBlocks[i] = -1;
+  }
+}
+
+int FS::allocateIndexBlock() {
+  std::vector<extent> blocks;
+  try {
+    blocks = this->findFreeBlock(1, 1);
+  } catch (const std::runtime_error&) {
+    return -1;
+  }
+
+  //  todos los bytes en 0xFF: cada entrada (int o extent) queda en -1
+  std::vector<char> vacio(BLOCK_SIZE, (char)0xFF);
+  this->writeMeta(blocks[0].start, 0, vacio.data(), BLOCK_SIZE);
+  return blocks[0].start;
+}
+
+int FS::writeExtentSlot(inode& node, int slot, const extent& e) {
+  if (slot < EXTENT_COUNT) {
+    node.extents[slot] = e;
+    return 0;
+  }
+
+  slot -= EXTENT_COUNT;
+  if (slot < EXTENTS_PER_BLOCK) {
+    if (node.indirectBlocks[0] == -1 && (node.indirectBlocks[0] = this->allocateIndexBlock()) == -1) {
+      return -1;
+    }
+    return this->writeMeta(node.indirectBlocks[0], slot * sizeof(extent), &e, sizeof(extent));
+  }
+
+  slot -= EXTENTS_PER_BLOCK;
+  if (node.indirectBlocks[1] == -1 && (node.indirectBlocks[1] = this->allocateIndexBlock()) == -1) {
+    return -1;
+  }
+
+  //  el indirecto doble guarda numeros de bloque; cada uno es un bloque de extents
+  size_t pointerOffset = (slot / EXTENTS_PER_BLOCK) * sizeof(int);
+  int extentBlock;
+  this->readMeta(node.indirectBlocks[1], pointerOffset, &extentBlock, sizeof(int));
+  if (extentBlock == -1) {
+    if ((extentBlock = this->allocateIndexBlock()) == -1) {
+      return -1;
+    }
+    this->writeMeta(node.indirectBlocks[1], pointerOffset, &extentBlock, sizeof(int));
+  }
+  return this->writeMeta(extentBlock, (slot % EXTENTS_PER_BLOCK) * sizeof(extent), &e, sizeof(extent));
+}
+
+int FS::readExtentSlot(const inode& node, int slot, extent& e) {
+  if (slot < EXTENT_COUNT) {
+    e = node.extents[slot];
+    return 0;
+  }
+
+  slot -= EXTENT_COUNT;
+  if (slot < EXTENTS_PER_BLOCK) {
+    return this->readMeta(node.indirectBlocks[0], slot * sizeof(extent), &e, sizeof(extent));
+  }
+
+  slot -= EXTENTS_PER_BLOCK;
+  int extentBlock;
+  this->readMeta(node.indirectBlocks[1], (slot / EXTENTS_PER_BLOCK) * sizeof(int), &extentBlock, sizeof(int));
+  return this->readMeta(extentBlock, (slot % EXTENTS_PER_BLOCK) * sizeof(extent), &e, sizeof(extent));
+}
+
+int FS::appendExtent(int number, const extent& e) {
+  inode& node = this->inodeAt(number);
+  auto cached = this->blockMaps.find(number);
+
+  //  si el extent nuevo sigue justo despues del ultimo, solo se alarga el ultimo
+  if (node.extentCount > 0) {
+    extent last;
+    if (this->readExtentSlot(node, node.extentCount - 1, last) == -1) {
+      return -1;
+    }
+    if (last.start + last.length == e.start) {
+      last.length += e.length;
+      this->markInodeDirty(number);
+      if (this->writeExtentSlot(node, node.extentCount - 1, last) == -1) {
+        return -1;
+      }
+      if (cached != this->blockMaps.end()) {
+        cached->second->extents.back() = last;
+      }
+      return 0;
+    }
+  }
+
+  if (node.extentCount == MAX_EXTENTS) {
+    return -1;
+  }
+  this->markInodeDirty(number);
+  if (this->writeExtentSlot(node, node.extentCount, e) == -1) {
+    return -1;
+  }
+  node.extentCount++;
+
+  //  mantener al dia el mapa en cache en lugar de volver a leerlo
+  if (cached != this->blockMaps.end()) {
+    blockMap& map = *cached->second;
+    int logical = map.extents.empty() ? 0 : map.firstLogical.back() + map.extents.back().length;
+    map.extents.push_back(e);
+    map.firstLogical.push_back(logical);
+  }
+  return 0;
+}
+
+int FS::remapBlock(int number, int logicalBlock, int physical) {
+  std::shared_ptr<const blockMap> map = this->getBlockMap(number);
+  int owned = map->extents.empty() ? 0 : map->firstLogical.back() + map->extents.back().length;
+  if (logicalBlock == owned) {
+    return this->appendExtent(number, extent{physical, 1});
+  }
+
+  //  el extent que contiene al bloque se parte en hasta tres: lo de antes, el
+  //  bloque nuevo y lo de despues; los vecinos contiguos se vuelven a unir
+  auto it = std::upper_bound(map->firstLogical.begin(), map->firstLogical.end(), logicalBlock);
+  if (it == map->firstLogical.begin() || logicalBlock > owned) {
+    return -1;
+  }
+  int i = it - map->firstLogical.begin() - 1;
+  const extent& viejo = map->extents[i];
+  int k = logicalBlock - map->firstLogical[i];
+
+  std::vector<extent> partes;
+  if (k > 0) {
+    partes.push_back({viejo.start, k});
+  }
+  partes.push_back({physical, 1});
+  if (k + 1 < viejo.length) {
+    partes.push_back({viejo.start + k + 1, viejo.length - k - 1});
+  }
+
+  int from = std::max(i - 1, 0);
+  std::vector<extent> extents(map->extents.begin(), map->extents.begin() + from);
+  std::vector<extent> cambiados(map->extents.begin() + from, map->extents.begin() + i);
+  cambiados.insert(cambiados.end(), partes.begin(), partes.end());
+  cambiados.insert(cambiados.end(), map->extents.begin() + i + 1, map->extents.end());
+  for (const extent& e : cambiados) {
+    if (!extents.empty() && (int)extents.size() > from && extents.back().start + extents.back().length == e.start) {
+      extents.back().length += e.length;
+    } else {
+      extents.push_back(e);
+    }
+  }
+  return this->setExtents(number, extents, from);
+}
+
+int FS::replaceTail(int number, int first, const std::vector<extent>& tail) {
+  std::shared_ptr<const blockMap> map = this->getBlockMap(number);
+  std::vector<extent> extents;
+  std::vector<int> anteriores;
+  for (size_t i = 0; i < map->extents.size(); i++) {
+    const extent& e = map->extents[i];
+    int keep = std::clamp(first - map->firstLogical[i], 0, e.length);
+    if (keep > 0) {
+      extents.push_back({e.start, keep});
+    }
+    for (int b = keep; b < e.length; b++) {
+      anteriores.push_back(e.start + b);
+    }
+  }
+
+  //  el ultimo extent que queda puede cambiar si tail sigue contiguo a el
+  int from = std::max((int)extents.size() - 1, 0);
+  for (const extent& e : tail) {
+    if (!extents.empty() && extents.back().start + extents.back().length == e.start) {
+      extents.back().length += e.length;
+    } else {
+      extents.push_back(e);
+    }
+  }
+  if (this->setExtents(number, extents, from) == -1) {
+    return -1;
+  }
+  for (int block : anteriores) {
+    this->releaseBlock(block);
+  }
+  return 0;
+}
+
+int FS::setExtents(int number, const std::vector<extent>& extents, int from) {
+  if (extents.size() > MAX_EXTENTS) {
+    return -1;
+  }
+  inode& node = this->inodeAt(number);
+  for (size_t slot = from; slot < extents.size(); slot++) {
+    if (this->writeExtentSlot(node, slot, extents[slot]) == -1) {
+      return -1;
+    }
+  }
+  node.extentCount = extents.size();
+  this->markInodeDirty(number);
+
+  //  quien tenga el mapa anterior sigue con su copia; el proximo se arma de nuevo
+  this->blockMaps.erase(number);
+  return 0;
+}
+
+int FS::loadExtents(const inode& node, std::vector<extent>& extents) {
+  extents.clear();
+  int restantes = node.extentCount;
+
+  for (int i = 0; i < EXTENT_COUNT && restantes > 0; i++, restantes--) {
+    extents.push_back(node.extents[i]);
+  }
+
+  //  cada bloque indirecto se lee una sola vez
+  std::vector<extent> bloque(EXTENTS_PER_BLOCK);
+  if (restantes > 0) {
+    if (this->readMeta(node.indirectBlocks[0], 0, bloque.data(), BLOCK_SIZE) == -1) {
+      return -1;
+    }
+    int n = std::min(restantes, EXTENTS_PER_BLOCK);
+    extents.insert(extents.end(), bloque.begin(), bloque.begin() + n);
+    restantes -= n;
+  }
+
+  if (restantes > 0) {
+    std::vector<int> punteros(POINTERS_PER_BLOCK);
+    if (this->readMeta(node.indirectBlocks[1], 0, punteros.data(), BLOCK_SIZE) == -1) {
+      return -1;
+    }
+    for (int p = 0; p < POINTERS_PER_BLOCK && restantes > 0; p++) {
+      if (this->readMeta(punteros[p], 0, bloque.data(), BLOCK_SIZE) == -1) {
+        return -1;
+      }
+      int n = std::min(restantes, EXTENTS_PER_BLOCK);
+      extents.insert(extents.end(), bloque.begin(), bloque.begin() + n);
+      restantes -= n;
+    }
+  }
+  return 0;
+}
+
+std::shared_ptr<const blockMap> FS::getBlockMap(int number) {
+  auto cached = this->blockMaps.find(number);
+  if (cached != this->blockMaps.end()) {
+    return cached->second;
+  }
+
+  //  quien todavia lee con un mapa sacado de la cache sigue teniendo su copia
+  if (this->blockMaps.size() >= BLOCK_MAP_CACHE_SIZE) {
+    this->blockMaps.clear();
+  }
+
+  std::shared_ptr<blockMap> map = std::make_shared<blockMap>();
+  this->loadExtents(this->inodeAt(number), map->extents);
+  int logical = 0;
+  for (const extent& e : map->extents) {
+    map->firstLogical.push_back(logical);
+    logical += e.length;
+  }
+  this->blockMaps[number] = map;
+  return map;
+}
+
+int FS::mapBlock(int number, int logicalBlock) {
+  std::shared_ptr<const blockMap> map = this->getBlockMap(number);
+
+  //  ultimo extent cuyo primer bloque logico es <= logicalBlock
+  auto it = std::upper_bound(map->firstLogical.begin(), map->firstLogical.end(), logicalBlock);
+  if (it == map->firstLogical.begin()) {
+    return -1;
+  }
+  size_t i = it - map->firstLogical.begin() - 1;
+  int offset = logicalBlock - map->firstLogical[i];
+  if (offset >= map->extents[i].length) {
+    return -1;
+  }
+  return map->extents[i].start + offset;
+}
+
+int FS::freeDataBlocks(int number){
+  inode& node = this->inodeAt(number);
+  std::shared_ptr<const blockMap> map = this->getBlockMap(number);
+
+  for (const extent& e : map->extents) {
+    for (int b = 0; b < e.length; b++) {
+      this->releaseBlock(e.start + b);
+    }
+  }
+
+  this->releaseIndirectBlocks(node);
+
+  this->blockMaps.erase(number);
+  this->readAheads.erase(number);
+  this->resetExtents(node);
+  memset(node.inlineData, 0, INLINE_DATA_SIZE);
+  this->markInodeDirty(number);
+  return 0;
+}
+
+void FS::releaseIndirectBlocks(const inode& node) {
+  if (node.indirectBlocks[0] != -1) {
+    this->releaseBlock(node.indirectBlocks[0]);
+  }
+  if (node.indirectBlocks[1] != -1) {
+    std::vector<int> punteros(POINTERS_PER_BLOCK);
+    this->readMeta(node.indirectBlocks[1], 0, punteros.data(), BLOCK_SIZE);
+    for (int p = 0; p < POINTERS_PER_BLOCK; p++) {
+      if (punteros[p] != -1) {
+        this->releaseBlock(punteros[p]);
+      }
+    }
+    this->releaseBlock(node.indirectBlocks[1]);
+  }
+}
@@ -0,0 +1,266 @@
+#include "../include/FS.h"
+#include "../include/Crc32c.h"
+#include <atomic>
+#include <cstddef>
+#include <iostream>
+#include <thread>
+
+//  checksums por bloque: toda la tabla vive en memoria (4 bytes por bloque) y
+//  cada bloque que llega del disco a la cache se compara con su entrada, asi
+//  un bloque se revisa una sola vez por lectura real y los aciertos no cuestan.
+//  Los datos se escriben en su lugar fuera del journal, asi que una caida
+//  entre la escritura de un bloque y el commit con su checksum nuevo lo
+//  dejaria como danado. Para evitarlo, un bloque que ya tiene checksum se
+//  reescribe en su lugar solo cuando su tramo de la tabla esta marcado en
+//  disco. La marca va en la transaccion de la escritura que la pide, y
+//  mientras no es durable los bloques del tramo se mueven a bloques nuevos
+//  como los compartidos; al montar despues de una caida los checksums de los
+//  tramos marcados se rehacen con lo que haya en disco, y al desmontar
+//  normalmente las marcas se borran
+
+//  en la tabla 0 quiere decir "sin checksum": un bloque cuyo CRC32C da 0 se
+//  guarda con este otro valor, y al verificar se compara igual mapeado
+static const uint32_t ZERO_CHECKSUM = 0xFFFFFFFFu;
+
+static uint32_t storedChecksum(uint32_t crc) {
+  return crc == 0 ? ZERO_CHECKSUM : crc;
+}
+
+static uint32_t blockChecksum(const void* data) {
+  return storedChecksum(Crc32c::compute(data, BLOCK_SIZE));
+}
+
+static uint32_t tableChecksum(const checksumBlock& table) {
+  return Crc32c::compute(&table, offsetof(checksumBlock, checksum));
+}
+
+void FS::resetChecksums() {
+  std::lock_guard<std::mutex> guard(this->checksumLock);
+  this->checksums.assign((size_t)this->sb.checksumBlocks * CHECKSUMS_PER_BLOCK, 0);
+  this->overwritten.assign(this->sb.checksumBlocks, 0);
+  this->markTickets.assign(this->sb.checksumBlocks, 0);
+  this->checksumTableStart = this->sb.checksumStart;
+  this->dirtyChecksumBlocks.clear();
+  this->freedChecksums.clear();
+  for (int t = 0; t < this->sb.checksumBlocks; t++) {
+    this->dirtyChecksumBlocks.insert(t);
+  }
+}
+
+int FS::loadChecksums() {
+  std::vector<checksumBlock> table(this->sb.checksumBlocks);
+  if (this->disk->readDirect((size_t)this->sb.checksumStart * BLOCK_SIZE, table.data(),
+      table.size() * sizeof(checksumBlock)) == -1) {
+    return -1;
+  }
+
+  std::lock_guard<std::mutex> guard(this->checksumLock);
+  this->checksums.assign(table.size() * CHECKSUMS_PER_BLOCK, 0);
+  this->overwritten.assign(table.size(), 0);
+  this->markTickets.assign(table.size(), 0);
+  this->checksumTableStart = this->sb.checksumStart;
+  this->dirtyChecksumBlocks.clear();
+  this->freedChecksums.clear();
+  for (size_t t = 0; t < table.size(); t++) {
+    if (tableChecksum(table[t]) != table[t].checksum) {
+      std::cout << "Bloque " << this->sb.checksumStart + t << " de la tabla de checksums danado: sus "
+                << CHECKSUMS_PER_BLOCK << " bloques quedan sin revisar\n";
+      continue;
+    }
+    memcpy(&this->checksums[t * CHECKSUMS_PER_BLOCK], table[t].entries, sizeof(table[t].entries));
+    this->overwritten[t] = table[t].overwritten;
+  }
+  return 0;
+}
+
+int FS::settleChecksums() {
+  std::lock_guard<std::mutex> guard(this->checksumLock);
+  std::vector<char> block(BLOCK_SIZE);
+  for (size_t t = 0; t < this->overwritten.size(); t++) {
+    if (!this->overwritten[t]) {
+      continue;
+    }
+    size_t desde = t * CHECKSUMS_PER_BLOCK;
+    size_t hasta = std::min(desde + CHECKSUMS_PER_BLOCK, (size_t)this->sb.TotalBlocks);
+    for (size_t b = desde; b < hasta; b++) {
+      if (this->checksums[b] == 0) {
+        continue;
+      }
+      if (this->disk->readDirect(b * BLOCK_SIZE, block.data(), BLOCK_SIZE) == -1) {
+        return -1;
+      }
+      this->checksums[b] = blockChecksum(block.data());
+    }
+    this->overwritten[t] = 0;
+    this->dirtyChecksumBlocks.insert(t);
+  }
+  return 0;
+}
+
+int FS::markOverwrites(const blockMap& map, size_t offset, size_t size, std::unordered_set<int>& unmarked) {
+  if (size == 0) {
+    return 0;
+  }
+  int first = offset / this->sb.blockSize;
+  int last = (offset + size - 1) / this->sb.blockSize;
+  uint64_t durable;
+  {
+    std::lock_guard<std::mutex> guard(this->durableLock);
+    durable = this->durableSequence;
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(this->checksumLock);
+    for (size_t i = 0; i < map.extents.size(); i++) {
+      int desde = std::max(first, map.firstLogical[i]);
+      int hasta = std::min(last + 1, map.firstLogical[i] + map.extents[i].length);
+      for (int b = desde; b < hasta; b++) {
+        int fisico = map.extents[i].start + (b - map.firstLogical[i]);
+        //  la imagen durable no usa los bloques frescos: no hace falta marca
+        bool conChecksum = this->checksums[fisico] != 0 || this->freedChecksums.count(fisico);
+        if (!conChecksum || this->freshBlocks.count(fisico)) {
+          continue;
+        }
+        //  la marca va en la transaccion de quien escribe, y hasta que sea
+        //  durable los bloques de su tramo no se reescriben en su lugar
+        int t = fisico / CHECKSUMS_PER_BLOCK;
+        if (!this->overwritten[t]) {
+          this->overwritten[t] = 1;
+          this->markTickets[t] = this->openTransaction;
+          this->dirtyChecksumBlocks.insert(t);
+        }
+        if (this->markTickets[t] > durable) {
+          unmarked.insert(fisico);
+        }
+      }
+    }
+  }
+
+  //  sin lugar para moverlos, la marca tiene que estar en disco antes que
+  //  los datos nuevos
+  if (!unmarked.empty() && (int)unmarked.size() + INDIRECT_BLOCK_SIZE > this->sb.freeBlocks) {
+    unmarked.clear();
+    return this->commit();
+  }
+  return 0;
+}
+
+void FS::clearOverwrites() {
+  std::lock_guard<std::mutex> guard(this->checksumLock);
+  for (size_t t = 0; t < this->overwritten.size(); t++) {
+    if (this->overwritten[t]) {
+      this->overwritten[t] = 0;
+      this->dirtyChecksumBlocks.insert(t);
+    }
+  }
+}
+
+bool FS::verifyBlock(size_t block, const char* data) {
+  uint32_t expected;
+  {
+    std::lock_guard<std::mutex> guard(this->checksumLock);
+    size_t tableBlocks = this->checksums.size() / CHECKSUMS_PER_BLOCK;
+    if (block >= (size_t)this->checksumTableStart && block < this->checksumTableStart + tableBlocks) {
+      //  la tabla se protege a si misma
+      const checksumBlock* table = reinterpret_cast<const checksumBlock*>(data);
+      return tableChecksum(*table) == table->checksum;
+    }
+    if (block >= this->checksums.size() || this->checksums[block] == 0) {
+      return true;
+    }
+    expected = this->checksums[block];
+  }
+  return blockChecksum(data) == expected;
+}
+
+void FS::updateChecksums(const std::vector<std::pair<int, uint32_t>>& sums) {
+  std::lock_guard<std::mutex> guard(this->checksumLock);
+  for (const auto& sum : sums) {
+    this->checksums[sum.first] = storedChecksum(sum.second);
+    this->dirtyChecksumBlocks.insert(sum.first / CHECKSUMS_PER_BLOCK);
+  }
+}
+
+void FS::forgetChecksum(int block) {
+  std::lock_guard<std::mutex> guard(this->checksumLock);
+  if (this->checksums[block] != 0) {
+    this->checksums[block] = 0;
+    this->freedChecksums.insert(block);
+    this->dirtyChecksumBlocks.insert(block / CHECKSUMS_PER_BLOCK);
+  }
+}
+
+void FS::checksumWrites(std::vector<diskWrite>& writes, std::vector<checksumBlock>& images) {
+  std::lock_guard<std::mutex> guard(this->checksumLock);
+  for (const diskWrite& w : writes) {
+    int block = w.offset / BLOCK_SIZE;
+    this->checksums[block] = blockChecksum(w.buffer);
+    this->dirtyChecksumBlocks.insert(block / CHECKSUMS_PER_BLOCK);
+  }
+
+  //  images no crece despues de reservar: writes apunta a sus elementos
+  images.clear();
+  images.reserve(this->dirtyChecksumBlocks.size());
+  for (int t : this->dirtyChecksumBlocks) {
+    checksumBlock table;
+    memcpy(table.entries, &this->checksums[(size_t)t * CHECKSUMS_PER_BLOCK], sizeof(table.entries));
+    table.overwritten = this->overwritten[t];
+    table.checksum = tableChecksum(table);
+    images.push_back(table);
+    writes.push_back({(size_t)(this->checksumTableStart + t) * BLOCK_SIZE, &images.back(), BLOCK_SIZE});
+  }
+  this->dirtyChecksumBlocks.clear();
+  this->freedChecksums.clear();
+}
+
+int FS::scrub() {
+  //  con dirLock exclusivo no hay ninguna operacion en curso, y despues del
+  //  commit lo que esta en su lugar es exactamente lo que describe la tabla
+  std::unique_lock<std::shared_mutex> dir(this->dirLock);
+  std::lock_guard<std::mutex> meta(this->metaLock);
+  if (this->commit() == -1) {
+    return -1;
+  }
+
+  int total = this->sb.TotalBlocks;
+  std::vector<std::vector<int>> danados(SCRUB_THREADS);
+  std::atomic<bool> fallo{false};
+  std::vector<std::thread> hilos;
+  for (int h = 0; h < SCRUB_THREADS; h++) {
+    hilos.emplace_back([this, h, total, &danados, &fallo] {
+      //  cada hilo revisa un tramo contiguo de la imagen
+      int desde = (long)total * h / SCRUB_THREADS;
+      int hasta = (long)total * (h + 1) / SCRUB_THREADS;
+      std::vector<char> buffer((size_t)SCRUB_CHUNK_BLOCKS * BLOCK_SIZE);
+      for (int b = desde; b < hasta; b += SCRUB_CHUNK_BLOCKS) {
+        int n = std::min(SCRUB_CHUNK_BLOCKS, hasta - b);
+        if (this->disk->readDirect((size_t)b * BLOCK_SIZE, buffer.data(), (size_t)n * BLOCK_SIZE) == -1) {
+          fallo = true;
+          return;
+        }
+        for (int i = 0; i < n; i++) {
+          if (!this->verifyBlock(b + i, buffer.data() + (size_t)i * BLOCK_SIZE)) {
+            danados[h].push_back(b + i);
+          }
+        }
+      }
+    });
+  }
+  for (std::thread& hilo : hilos) {
+    hilo.join();
+  }
+  if (fallo) {
+    std::cout << "No se pudo leer el disco\n";
+    return -1;
+  }
+
+  int cantidad = 0;
+  for (const std::vector<int>& tramo : danados) {
+    for (int block : tramo) {
+      std::cout << "Bloque " << block << " danado: su checksum no coincide\n";
+      cantidad++;
+    }
+  }
+  std::cout << "scrub: " << total << " bloques revisados, " << cantidad << " danados" << std::endl;
+  return cantidad;
+}
@@ -0,0 +1,154 @@
+#include "../include/FS.h"
+#include "../include/Crc32c.h"
+#include <iostream>
+
+//  clones (reflink): el archivo nuevo recibe una copia de los extents del
+//  original y cada bloque de datos suma un dueno en refCounts, asi clonar solo
+//  escribe metadatos. Un bloque compartido no se escribe en su lugar: antes de
+//  una escritura que lo toca pasa a un bloque propio del archivo y el original
+//  pierde un dueno. Los bloques de extents (indirectos) nunca se comparten
+
+int FS::clone(const std::string& source, const std::string& target) {
+  durableScope durable(this);
+  if (this->refuseWrite()) {
+    return -1;
+  }
+  try {
+    this->create(target);
+  } catch (const std::runtime_error&) {
+    std::cout << "No se pudo crear \"" << target << "\"" << std::endl;
+    return -1;
+  }
+
+  int result = 0;
+  {
+    std::shared_lock<std::shared_mutex> dir(this->dirLock);
+    int from = this->lookup(source);
+    int to = this->lookup(target);
+    if (from == -1 || to == -1) {
+      std::cout << "File \"" << source << "\" does not exist." << std::endl;
+      result = -1;
+    } else {
+      //  siempre en el mismo orden, asi dos clones cruzados no se esperan entre si
+      std::shared_mutex& fromLock = this->inodeLock(from);
+      std::shared_mutex& toLock = this->inodeLock(to);
+      std::shared_lock<std::shared_mutex> reading(fromLock, std::defer_lock);
+      std::unique_lock<std::shared_mutex> writing(toLock, std::defer_lock);
+      if (&fromLock == &toLock) {
+        writing.lock();
+      } else if (&fromLock < &toLock) {
+        reading.lock();
+        writing.lock();
+      } else {
+        writing.lock();
+        reading.lock();
+      }
+
+      std::lock_guard<std::mutex> meta(this->metaLock);
+      this->loadBitMap();
+      inode original = this->inodeAt(from);
+      std::shared_ptr<const blockMap> map = this->getBlockMap(from);
+      if (this->setExtents(to, map->extents, 0) == -1) {
+        std::cout << "Insufficient space to store this file" << std::endl;
+        result = -1;
+      } else {
+        for (const extent& e : map->extents) {
+          for (int b = e.start; b < e.start + e.length; b++) {
+            this->shareBlock(b);
+          }
+        }
+        //  un inline o el encabezado de uno comprimido van en inlineData
+        inode& node = this->inodeAt(to);
+        memcpy(node.inlineData, original.inlineData, INLINE_DATA_SIZE);
+        node.inodeSize = original.inodeSize;
+        node.compressed = original.compressed;
+        node.deduped = original.deduped;
+        this->markInodeDirty(to);
+      }
+      this->saveChanges();
+    }
+  }
+
+  //  sin el clon a medias
+  if (result == -1) {
+    this->deleteFile(target);
+  }
+  return result;
+}
+
+int FS::breakSharing(int index, size_t offset, size_t size, std::unique_lock<std::mutex>& meta,
+                     const std::unordered_set<int>& unmarked) {
+  if (size == 0) {
+    return 0;
+  }
+  this->loadBitMap();
+  size_t blockSize = this->sb.blockSize;
+  std::shared_ptr<const blockMap> map = this->getBlockMap(index);
+  int owned = map->extents.empty() ? 0 : map->firstLogical.back() + map->extents.back().length;
+  int first = offset / blockSize;
+  int last = std::min((int)((offset + size - 1) / blockSize), owned - 1);
+
+  std::vector<std::pair<int, int>> shared;  //  bloque logico y fisico
+  for (int logical = first; logical <= last; logical++) {
+    int block = this->mapBlock(index, logical);
+    if (block != -1 && (this->refCounts[block] > 0 || unmarked.count(block))) {
+      shared.push_back({logical, block});
+    }
+  }
+  if (shared.empty()) {
+    return 0;
+  }
+  if ((int)shared.size() > this->sb.freeBlocks) {
+    std::cout << "Insufficient space to store this file" << std::endl;
+    return -1;
+  }
+
+  //  primero se reserva un bloque propio para cada compartido
+  std::vector<int> nuevos;
+  int goal = -1;
+  for (const auto& [logical, anterior] : shared) {
+    try {
+      nuevos.push_back(this->findFreeBlock(1, 1, goal != -1 ? goal : anterior)[0].start);
+    } catch (const std::runtime_error&) {
+      std::cout << "Insufficient space to store this file" << std::endl;
+      for (int block : nuevos) {
+        this->releaseBlock(block);
+      }
+      return -1;
+    }
+    goal = nuevos.back() + 1;
+  }
+
+  //  un bloque que la escritura no cubre entero conserva lo que tenia; los
+  //  cubiertos enteros no necesitan copia. Las copias se hacen sin metaLock:
+  //  el archivo tiene su lock exclusivo y nadie cambia en su lugar un bloque
+  //  compartido, que tampoco se libera mientras este archivo sea su dueno
+  meta.unlock();
+  std::vector<char> content(blockSize);
+  std::vector<std::pair<int, uint32_t>> sums;
+  int result = 0;
+  for (size_t i = 0; i < shared.size() && result == 0; i++) {
+    size_t blockStart = (size_t)shared[i].first * blockSize;
+    if (blockStart < offset || blockStart + blockSize > offset + size) {
+      if (this->disk->read((size_t)shared[i].second * blockSize, content.data(), blockSize) == -1 ||
+          this->disk->write((size_t)nuevos[i] * blockSize, content.data(), blockSize) == -1) {
+        result = -1;
+      }
+      sums.push_back({nuevos[i], Crc32c::compute(content.data(), blockSize)});
+    }
+  }
+  if (result == 0) {
+    this->updateChecksums(sums);
+  }
+  meta.lock();
+
+  //  recien ahora el archivo pasa a los bloques propios; el anterior pierde
+  //  un dueno, o se libera si los otros lo soltaron mientras tanto
+  for (size_t i = 0; i < shared.size(); i++) {
+    if (result == 0 && this->remapBlock(index, shared[i].first, nuevos[i]) == -1) {
+      result = -1;
+    }
+    this->releaseBlock(result == 0 ? shared[i].second : nuevos[i]);
+  }
+  return result;
+}
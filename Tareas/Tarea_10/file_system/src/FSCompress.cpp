@@ -0,0 +1,201 @@
+#include "../include/FS.h"
+#include "../include/Lz.h"
+#include "../include/Crc32c.h"
+#include <iostream>
+
+//  archivos comprimidos: el contenido se corta en chunks de COMPRESS_CHUNK_SIZE
+//  bytes que se comprimen por separado con Lz y se guardan seguidos en los
+//  bloques del archivo, sin alinear. Despues de ellos va el indice con el
+//  offset de cada chunk, asi leer un rango solo lee y descomprime sus chunks.
+//  Un chunk que no se achica se guarda tal cual y se reconoce porque ocupa
+//  exactamente lo mismo que sin comprimir
+
+int FS::readCompressed(int number, size_t offset, char* data, size_t size) {
+  if (size == 0) {
+    return 0;
+  }
+  compressedHeader header;
+  size_t fileSize;
+  {
+    std::lock_guard<std::mutex> meta(this->metaLock);
+    const inode& node = this->inodeAt(number);
+    memcpy(&header, node.inlineData, sizeof(compressedHeader));
+    fileSize = node.inodeSize;
+  }
+  size_t end = offset + size;
+  if (header.chunks != (fileSize + COMPRESS_CHUNK_SIZE - 1) / COMPRESS_CHUNK_SIZE || end > fileSize) {
+    return -1;
+  }
+
+  //  del indice solo las entradas de los chunks que tocan el rango
+  size_t first = offset / COMPRESS_CHUNK_SIZE;
+  size_t last = (end - 1) / COMPRESS_CHUNK_SIZE;
+  std::vector<uint32_t> offsets(last - first + 2);
+  if (this->readStream(number, header.indexOffset + first * sizeof(uint32_t),
+                       reinterpret_cast<char*>(offsets.data()), offsets.size() * sizeof(uint32_t)) == -1) {
+    return -1;
+  }
+  if (offsets.back() < offsets.front() || offsets.back() > header.indexOffset) {
+    return -1;
+  }
+
+  //  todos los chunks del rango en una sola lectura
+  std::vector<char> packed(offsets.back() - offsets.front());
+  if (this->readStream(number, offsets.front(), packed.data(), packed.size()) == -1) {
+    return -1;
+  }
+
+  std::vector<char> chunk(COMPRESS_CHUNK_SIZE);
+  for (size_t c = first; c <= last; c++) {
+    size_t chunkStart = c * COMPRESS_CHUNK_SIZE;
+    size_t rawSize = std::min((size_t)COMPRESS_CHUNK_SIZE, fileSize - chunkStart);
+    size_t from = std::max(offset, chunkStart);
+    size_t to = std::min(end, chunkStart + rawSize);
+    if (offsets[c - first + 1] < offsets[c - first]) {
+      return -1;
+    }
+    const char* source = packed.data() + (offsets[c - first] - offsets.front());
+    size_t packedSize = offsets[c - first + 1] - offsets[c - first];
+
+    if (packedSize == rawSize) {
+      memcpy(data + (from - offset), source + (from - chunkStart), to - from);
+      continue;
+    }
+    //  un chunk pedido entero se descomprime directo en data
+    bool whole = from == chunkStart && to == chunkStart + rawSize;
+    char* out = whole ? data + (from - offset) : chunk.data();
+    if (Lz::decompress(source, packedSize, out, rawSize) != (long)rawSize) {
+      std::cout << "Chunk " << c << " del archivo danado\n";
+      return -1;
+    }
+    if (!whole) {
+      memcpy(data + (from - offset), chunk.data() + (from - chunkStart), to - from);
+    }
+  }
+  return 0;
+}
+
+long FS::writeCompressed(int index, size_t offset, const char* data, size_t size) {
+  size_t end = offset + size;
+  compressedHeader header = {0, 0};
+  std::vector<char> inlineContent;
+  size_t oldSize;
+  {
+    std::lock_guard<std::mutex> meta(this->metaLock);
+    const inode& node = this->inodeAt(index);
+    oldSize = node.inodeSize;
+    if (isInline(node)) {
+      inlineContent.assign(node.inlineData, node.inlineData + oldSize);
+    } else {
+      memcpy(&header, node.inlineData, sizeof(compressedHeader));
+    }
+  }
+  size_t newSize = std::max(oldSize, end);
+
+  //  se comprime de nuevo desde el chunk donde empieza el cambio, o el hueco
+  //  si se escribe despues del final
+  size_t firstChunk = std::min(offset, oldSize) / COMPRESS_CHUNK_SIZE;
+  size_t from = firstChunk * COMPRESS_CHUNK_SIZE;
+  std::vector<uint32_t> offsets(firstChunk + 1, 0);
+  if (header.chunks > 0 && this->readStream(index, header.indexOffset, reinterpret_cast<char*>(offsets.data()),
+                                            offsets.size() * sizeof(uint32_t)) == -1) {
+    return -1;
+  }
+
+  //  lo que habia desde from, con los datos nuevos encima
+  std::vector<char> content(newSize - from, 0);
+  if (!inlineContent.empty()) {
+    memcpy(content.data(), inlineContent.data(), inlineContent.size());
+  } else if (oldSize > from && this->readCompressed(index, from, content.data(), oldSize - from) == -1) {
+    return -1;
+  }
+  memcpy(content.data() + (offset - from), data, size);
+
+  //  los chunks nuevos seguidos y despues el indice entero
+  size_t chunks = (newSize + COMPRESS_CHUNK_SIZE - 1) / COMPRESS_CHUNK_SIZE;
+  std::vector<char> stream;
+  std::vector<char> packed(COMPRESS_CHUNK_SIZE);
+  for (size_t c = firstChunk; c < chunks; c++) {
+    const char* raw = content.data() + (c * COMPRESS_CHUNK_SIZE - from);
+    size_t rawSize = std::min((size_t)COMPRESS_CHUNK_SIZE, newSize - c * COMPRESS_CHUNK_SIZE);
+    long n = Lz::compress(raw, rawSize, packed.data(), rawSize - 1);
+    if (n == -1) {
+      stream.insert(stream.end(), raw, raw + rawSize);
+    } else {
+      stream.insert(stream.end(), packed.data(), packed.data() + n);
+    }
+    offsets.push_back(offsets[firstChunk] + stream.size());
+  }
+  header = {offsets.back(), (uint32_t)chunks};
+  const char* index32 = reinterpret_cast<const char*>(offsets.data());
+  stream.insert(stream.end(), index32, index32 + offsets.size() * sizeof(uint32_t));
+  size_t streamStart = offsets[firstChunk];
+
+  //  los bloques desde el que tiene streamStart se reemplazan enteros: el
+  //  primero conserva lo de los chunks anteriores que cae en el
+  size_t blockSize = this->sb.blockSize;
+  int firstBlock = streamStart / blockSize;
+  size_t head = streamStart - (size_t)firstBlock * blockSize;
+  int count = (head + stream.size() + blockSize - 1) / blockSize;
+  std::vector<char> image((size_t)count * blockSize, 0);
+  if (head > 0 && this->readStream(index, (size_t)firstBlock * blockSize, image.data(), head) == -1) {
+    return -1;
+  }
+  memcpy(image.data() + head, stream.data(), stream.size());
+
+  //  todo va a bloques nuevos, como en writeDeduped: los chunks y el indice
+  //  anteriores siguen enteros hasta que el encabezado nuevo se publica en la
+  //  misma transaccion que el mapa
+  std::unique_lock<std::mutex> meta(this->metaLock);
+  this->loadBitMap();
+  //  con lugar tambien para los bloques de extents que el mapa nuevo pueda pedir
+  if (count + INDIRECT_BLOCK_SIZE > this->sb.freeBlocks) {
+    std::cout << "Insufficient space to store this file" << std::endl;
+    return -1;
+  }
+  std::vector<extent> nuevos;
+  try {
+    int goal = firstBlock > 0 ? this->mapBlock(index, firstBlock - 1) + 1 : -1;
+    nuevos = this->findFreeBlock(count, MAX_EXTENTS, goal);
+  } catch (const std::runtime_error&) {
+    std::cout << "Insufficient space to store this file" << std::endl;
+    return -1;
+  }
+  std::vector<diskWrite> writes;
+  std::vector<std::pair<int, uint32_t>> sums;
+  size_t position = 0;
+  for (const extent& e : nuevos) {
+    writes.push_back({(size_t)e.start * blockSize, image.data() + position, (size_t)e.length * blockSize});
+    for (int b = 0; b < e.length; b++, position += blockSize) {
+      sums.push_back({e.start + b, Crc32c::compute(image.data() + position, blockSize)});
+    }
+  }
+
+  meta.unlock();
+  int result = this->disk->writeBatch(writes);
+  if (result == 0) {
+    this->updateChecksums(sums);
+  }
+
+  meta.lock();
+  if (result == 0) {
+    result = this->replaceTail(index, firstBlock, nuevos);
+  }
+  if (result == -1) {
+    std::cout << "No se pudo escribir en el disco\n";
+    for (const extent& e : nuevos) {
+      for (int b = 0; b < e.length; b++) {
+        this->releaseBlock(e.start + b);
+      }
+    }
+    return -1;
+  }
+
+  //  el encabezado y el inodeSize nuevos en la misma transaccion que el mapa
+  inode& written = this->inodeAt(index);
+  memset(written.inlineData, 0, INLINE_DATA_SIZE);
+  memcpy(written.inlineData, &header, sizeof(compressedHeader));
+  written.inodeSize = newSize;
+  this->markInodeDirty(index);
+  return size;
+}
@@ -0,0 +1,232 @@
+#include "../include/FS.h"
+#include "../include/Crc32c.h"
+#include <iostream>
+
+//  dedup por contenido: cada bloque de un archivo con dedup se identifica por
+//  su hash de 128 bits. Si ya hay un bloque con ese hash y los mismos bytes se
+//  usa ese y se le suma un dueno; si no, va a un bloque nuevo que queda en el
+//  indice. Como un bloque compartido no se puede cambiar en su lugar, estos
+//  archivos nunca se reescriben en su lugar: cada bloque tocado se reemplaza
+//  y el anterior pierde un dueno (o se libera si era el ultimo)
+
+void FS::loadSharing() {
+  this->refCounts.assign(this->sb.TotalBlocks, 0);
+  this->blockHashes.assign(this->sb.TotalBlocks, hash128{0, 0});
+  this->dedupIndex.clear();
+  if (this->disk->read((size_t)this->sb.refCountStart * BLOCK_SIZE, this->refCounts.data(),
+                       this->refCounts.size() * sizeof(uint32_t)) == -1 ||
+      this->disk->read((size_t)this->sb.dedupStart * BLOCK_SIZE, this->blockHashes.data(),
+                       this->blockHashes.size() * sizeof(hash128)) == -1) {
+    std::cout << "No se pudieron leer las cuentas de referencias\n";
+    return;
+  }
+  for (int b = 0; b < this->sb.TotalBlocks; b++) {
+    if (!(this->blockHashes[b] == hash128{0, 0})) {
+      this->dedupIndex[this->blockHashes[b]] = b;
+    }
+  }
+}
+
+void FS::shareBlock(int block) {
+  this->refCounts[block]++;
+  this->writeMeta(this->sb.refCountStart + block / REFCOUNTS_PER_BLOCK,
+                  (block % REFCOUNTS_PER_BLOCK) * sizeof(uint32_t), &this->refCounts[block], sizeof(uint32_t));
+}
+
+bool FS::unshareBlock(int block) {
+  if (this->refCounts[block] == 0) {
+    return false;
+  }
+  this->refCounts[block]--;
+  this->writeMeta(this->sb.refCountStart + block / REFCOUNTS_PER_BLOCK,
+                  (block % REFCOUNTS_PER_BLOCK) * sizeof(uint32_t), &this->refCounts[block], sizeof(uint32_t));
+  return true;
+}
+
+void FS::rememberHash(int block, const hash128& hash) {
+  this->blockHashes[block] = hash;
+  this->dedupIndex[hash] = block;
+  this->writeMeta(this->sb.dedupStart + block / HASHES_PER_BLOCK,
+                  (block % HASHES_PER_BLOCK) * sizeof(hash128), &hash, sizeof(hash128));
+}
+
+void FS::forgetHash(int block) {
+  hash128 hash = this->blockHashes[block];
+  if (hash == hash128{0, 0}) {
+    return;
+  }
+  auto found = this->dedupIndex.find(hash);
+  if (found != this->dedupIndex.end() && found->second == block) {
+    this->dedupIndex.erase(found);
+  }
+  this->blockHashes[block] = hash128{0, 0};
+  this->writeMeta(this->sb.dedupStart + block / HASHES_PER_BLOCK,
+                  (block % HASHES_PER_BLOCK) * sizeof(hash128), &this->blockHashes[block], sizeof(hash128));
+}
+
+long FS::writeDeduped(int index, size_t offset, const char* data, size_t size) {
+  size_t blockSize = this->sb.blockSize;
+  size_t end = offset + size;
+  size_t oldSize = this->sizeOf(index);
+  size_t newSize = std::max(oldSize, end);
+
+  //  bloques enteros desde el que tiene el final anterior si hay un hueco
+  size_t first = std::min(offset, oldSize) / blockSize;
+  size_t last = (end - 1) / blockSize;
+  size_t count = last - first + 1;
+  std::vector<char> content(count * blockSize, 0);
+
+  //  de lo anterior solo hace falta lo que sigue en el primer y el ultimo bloque
+  size_t headEnd = std::min(oldSize, (first + 1) * blockSize);
+  if (headEnd > first * blockSize &&
+      this->readDisk(index, first * blockSize, content.data(), headEnd - first * blockSize) == -1) {
+    return -1;
+  }
+  size_t tailEnd = std::min(oldSize, (last + 1) * blockSize);
+  if (last != first && tailEnd > last * blockSize &&
+      this->readDisk(index, last * blockSize, content.data() + (count - 1) * blockSize,
+                     tailEnd - last * blockSize) == -1) {
+    return -1;
+  }
+  memcpy(content.data() + (offset - first * blockSize), data, size);
+
+  std::vector<hash128> hashes(count);
+  for (size_t i = 0; i < count; i++) {
+    hashes[i] = Murmur3::compute(content.data() + i * blockSize, blockSize);
+  }
+
+  //  el candidato de cada posicion sale del indice y queda con un dueno mas
+  //  mientras se comparan sus bytes sin metaLock, asi nadie lo libera
+  std::unique_lock<std::mutex> meta(this->metaLock);
+  this->loadBitMap();
+  std::vector<int> candidates(count, -1);
+  std::vector<int> anteriores(count, -1);
+  std::vector<diskRead> reads;
+  std::shared_ptr<const blockMap> map = this->getBlockMap(index);
+  int owned = map->extents.empty() ? 0 : map->firstLogical.back() + map->extents.back().length;
+  for (size_t i = 0; i < count; i++) {
+    int logical = first + i;
+    anteriores[i] = logical < owned ? this->mapBlock(index, logical) : -1;
+    auto found = this->dedupIndex.find(hashes[i]);
+    if (found != this->dedupIndex.end()) {
+      candidates[i] = found->second;
+      this->shareBlock(candidates[i]);
+    }
+  }
+  std::vector<char> stored((size_t)(count - std::count(candidates.begin(), candidates.end(), -1)) * blockSize);
+  for (size_t i = 0; i < count; i++) {
+    if (candidates[i] != -1) {
+      reads.push_back({(size_t)candidates[i] * blockSize, stored.data() + reads.size() * blockSize, blockSize});
+    }
+  }
+  std::vector<bool> iguales(count, false);
+  if (!reads.empty()) {
+    meta.unlock();
+    bool leido = this->disk->readBatch(reads) == 0;
+    for (size_t i = 0, r = 0; i < count; i++) {
+      if (candidates[i] != -1) {
+        iguales[i] = leido && memcmp(stored.data() + r * blockSize, content.data() + i * blockSize, blockSize) == 0;
+        r++;
+      }
+    }
+    meta.lock();
+  }
+
+  //  despues se elige el bloque de cada posicion: el candidato si tenia los
+  //  mismos bytes, uno nuevo de esta misma escritura igual, o uno nuevo
+  std::vector<int> blocks(count, -1);
+  std::vector<diskWrite> writes;
+  std::vector<std::pair<int, uint32_t>> sums;
+  std::unordered_map<int, const char*> pending;
+  int goal = -1;
+  for (size_t i = 0; i < count; i++) {
+    const char* source = content.data() + i * blockSize;
+    int block = -1;
+    if (iguales[i]) {
+      block = candidates[i];
+      if (block == anteriores[i]) {
+        this->releaseBlock(block);
+        continue;
+      }
+    } else {
+      if (candidates[i] != -1) {
+        this->releaseBlock(candidates[i]);
+      }
+      auto found = this->dedupIndex.find(hashes[i]);
+      if (found != this->dedupIndex.end()) {
+        auto nuevo = pending.find(found->second);
+        if (nuevo != pending.end() && memcmp(nuevo->second, source, blockSize) == 0) {
+          block = found->second;
+          this->shareBlock(block);
+        }
+      }
+    }
+    if (block == -1) {
+      std::vector<extent> nuevo;
+      try {
+        nuevo = this->findFreeBlock(1, 1, goal != -1 ? goal : anteriores[i]);
+      } catch (const std::runtime_error&) {
+        std::cout << "Insufficient space to store this file" << std::endl;
+        for (size_t j = 0; j < i; j++) {
+          if (blocks[j] != -1) {
+            this->releaseBlock(blocks[j]);
+          }
+        }
+        for (size_t j = i + 1; j < count; j++) {
+          if (candidates[j] != -1) {
+            this->releaseBlock(candidates[j]);
+          }
+        }
+        return -1;
+      }
+      block = nuevo[0].start;
+      this->rememberHash(block, hashes[i]);
+      writes.push_back({(size_t)block * blockSize, source, blockSize});
+      pending[block] = source;
+      sums.push_back({block, Crc32c::compute(source, blockSize)});
+      goal = block + 1;
+    }
+    blocks[i] = block;
+  }
+
+  //  los bloques nuevos se escriben sin metaLock y antes de que el archivo los
+  //  use: un commit en el medio nunca deja al archivo apuntando a basura
+  meta.unlock();
+  if (!writes.empty() && this->disk->writeBatch(writes) == -1) {
+    std::cout << "No se pudo escribir en el disco\n";
+    meta.lock();
+    for (int block : blocks) {
+      if (block != -1) {
+        this->releaseBlock(block);
+      }
+    }
+    return -1;
+  }
+  this->updateChecksums(sums);
+
+  meta.lock();
+  inode& node = this->inodeAt(index);
+  if (isInline(node)) {
+    //  lo que tenia ya esta en content
+    memset(node.inlineData, 0, INLINE_DATA_SIZE);
+  }
+  for (size_t i = 0; i < count; i++) {
+    if (blocks[i] == -1) {
+      continue;
+    }
+    if (this->remapBlock(index, first + i, blocks[i]) == -1) {
+      for (size_t j = i; j < count; j++) {
+        if (blocks[j] != -1) {
+          this->releaseBlock(blocks[j]);
+        }
+      }
+      return -1;
+    }
+    if (anteriores[i] != -1) {
+      this->releaseBlock(anteriores[i]);
+    }
+  }
+  this->inodeAt(index).inodeSize = newSize;
+  this->markInodeDirty(index);
+  return size;
+}
@@ -0,0 +1,369 @@
+#include "../include/FS.h"
+
+//  arbol B de grado minimo DIR_T: cada nodo (salvo la raiz) tiene entre
+//  DIR_T - 1 y 2 * DIR_T - 1 entradas, asi que buscar, insertar y borrar
+//  leen O(log n) bloques
+#define DIR_T ((DIR_MAX_KEYS + 1) / 2)
+
+static int compareName(const char* a, const char* b) {
+  return strncmp(a, b, MAX_NAME_LENGTH);
+}
+
+int FS::readDirNode(int block, dirNode& node) {
+  return this->readMeta(block, 0, &node, sizeof(dirNode));
+}
+
+int FS::writeDirNode(int block, const dirNode& node) {
+  return this->writeMeta(block, 0, &node, sizeof(dirNode));
+}
+
+int FS::allocateDirNode() {
+  std::vector<extent> blocks;
+  try {
+    blocks = this->findFreeBlock(1, 1);
+  } catch (const std::runtime_error&) {
+    return -1;
+  }
+
+  dirNode node;
+  memset(&node, 0, sizeof(dirNode));
+  node.leaf = 1;
+  this->writeDirNode(blocks[0].start, node);
+  return blocks[0].start;
+}
+
+int FS::dirLookup(const std::string& name) {
+  dirNode node;
+  int block = this->sb.dirRoot;
+  while (this->readDirNode(block, node) == 0) {
+    int i = 0;
+    while (i < node.count && compareName(name.c_str(), node.entries[i].name) > 0) {
+      i++;
+    }
+    if (i < node.count && compareName(name.c_str(), node.entries[i].name) == 0) {
+      return node.entries[i].inodeNumber;
+    }
+    if (node.leaf) {
+      return -1;
+    }
+    block = node.children[i];
+  }
+  return -1;
+}
+
+int FS::dirInsert(const std::string& name, int inodeNumber) {
+  dirEntry entry;
+  memset(&entry, 0, sizeof(dirEntry));
+  strncpy(entry.name, name.c_str(), MAX_NAME_LENGTH - 1);
+  entry.inodeNumber = inodeNumber;
+
+  dirNode root;
+  if (this->readDirNode(this->sb.dirRoot, root) == -1) {
+    return -1;
+  }
+
+  //  raiz llena: el arbol crece un nivel por arriba
+  if (root.count == DIR_MAX_KEYS) {
+    int newRoot = this->allocateDirNode();
+    if (newRoot == -1) {
+      return -1;
+    }
+    dirNode top;
+    memset(&top, 0, sizeof(dirNode));
+    top.leaf = 0;
+    top.children[0] = this->sb.dirRoot;
+    if (this->dirSplitChild(top, newRoot, 0) == -1) {
+      this->releaseBlock(newRoot);
+      return -1;
+    }
+    this->sb.dirRoot = newRoot;
+  }
+
+  return this->dirInsertNonFull(this->sb.dirRoot, entry);
+}
+
+int FS::dirSplitChild(dirNode& parent, int parentBlock, int index) {
+  //  pedir el bloque del hermano antes de tocar nada, asi un fallo deja el arbol intacto
+  int rightBlock = this->allocateDirNode();
+  if (rightBlock == -1) {
+    return -1;
+  }
+
+  int leftBlock = parent.children[index];
+  dirNode left;
+  dirNode right;
+  this->readDirNode(leftBlock, left);
+  memset(&right, 0, sizeof(dirNode));
+
+  //  la mitad derecha pasa al hermano nuevo y la entrada del medio sube al padre
+  right.leaf = left.leaf;
+  right.count = DIR_T - 1;
+  for (int j = 0; j < DIR_T - 1; j++) {
+    right.entries[j] = left.entries[j + DIR_T];
+  }
+  if (!left.leaf) {
+    for (int j = 0; j < DIR_T; j++) {
+      right.children[j] = left.children[j + DIR_T];
+    }
+  }
+  left.count = DIR_T - 1;
+
+  for (int j = parent.count; j > index; j--) {
+    parent.children[j + 1] = parent.children[j];
+  }
+  parent.children[index + 1] = rightBlock;
+  for (int j = parent.count - 1; j >= index; j--) {
+    parent.entries[j + 1] = parent.entries[j];
+  }
+  parent.entries[index] = left.entries[DIR_T - 1];
+  parent.count++;
+
+  this->writeDirNode(leftBlock, left);
+  this->writeDirNode(rightBlock, right);
+  this->writeDirNode(parentBlock, parent);
+  return 0;
+}
+
+int FS::dirInsertNonFull(int block, const dirEntry& entry) {
+  dirNode node;
+  while (this->readDirNode(block, node) == 0) {
+    int i = node.count - 1;
+    if (node.leaf) {
+      while (i >= 0 && compareName(entry.name, node.entries[i].name) < 0) {
+        node.entries[i + 1] = node.entries[i];
+        i--;
+      }
+      node.entries[i + 1] = entry;
+      node.count++;
+      return this->writeDirNode(block, node);
+    }
+
+    while (i >= 0 && compareName(entry.name, node.entries[i].name) < 0) {
+      i--;
+    }
+    i++;
+
+    //  partir un hijo lleno antes de bajar, para no tener que subir despues
+    dirNode child;
+    this->readDirNode(node.children[i], child);
+    if (child.count == DIR_MAX_KEYS) {
+      if (this->dirSplitChild(node, block, i) == -1) {
+        return -1;
+      }
+      if (compareName(entry.name, node.entries[i].name) > 0) {
+        i++;
+      }
+    }
+    block = node.children[i];
+  }
+  return -1;
+}
+
+int FS::dirRemove(const std::string& name) {
+  int result = this->dirRemoveFrom(this->sb.dirRoot, name);
+
+  //  una raiz interna sin entradas se reemplaza por su unico hijo
+  dirNode root;
+  this->readDirNode(this->sb.dirRoot, root);
+  if (root.count == 0 && !root.leaf) {
+    int oldRoot = this->sb.dirRoot;
+    this->sb.dirRoot = root.children[0];
+    this->releaseBlock(oldRoot);
+  }
+  return result;
+}
+
+int FS::dirRemoveFrom(int block, const std::string& name) {
+  dirNode node;
+  if (this->readDirNode(block, node) == -1) {
+    return -1;
+  }
+
+  int i = 0;
+  while (i < node.count && compareName(name.c_str(), node.entries[i].name) > 0) {
+    i++;
+  }
+
+  if (i < node.count && compareName(name.c_str(), node.entries[i].name) == 0) {
+    if (node.leaf) {
+      for (int j = i; j < node.count - 1; j++) {
+        node.entries[j] = node.entries[j + 1];
+      }
+      node.count--;
+      return this->writeDirNode(block, node);
+    }
+
+    //  entrada en un nodo interno: se reemplaza por el predecesor o el sucesor
+    //  si el hijo de ese lado puede ceder una entrada, si no se unen los dos hijos
+    dirNode left;
+    dirNode right;
+    this->readDirNode(node.children[i], left);
+    this->readDirNode(node.children[i + 1], right);
+
+    if (left.count >= DIR_T) {
+      dirNode walk = left;
+      while (!walk.leaf) {
+        this->readDirNode(walk.children[walk.count], walk);
+      }
+      node.entries[i] = walk.entries[walk.count - 1];
+      this->writeDirNode(block, node);
+      return this->dirRemoveFrom(node.children[i], node.entries[i].name);
+    }
+
+    if (right.count >= DIR_T) {
+      dirNode walk = right;
+      while (!walk.leaf) {
+        this->readDirNode(walk.children[0], walk);
+      }
+      node.entries[i] = walk.entries[0];
+      this->writeDirNode(block, node);
+      return this->dirRemoveFrom(node.children[i + 1], node.entries[i].name);
+    }
+
+    int leftBlock = node.children[i];
+    this->dirMerge(node, block, i);
+    return this->dirRemoveFrom(leftBlock, name);
+  }
+
+  if (node.leaf) {
+    return -1;
+  }
+
+  //  garantizar que el hijo por el que se baja tenga al menos DIR_T entradas
+  bool last = (i == node.count);
+  dirNode child;
+  this->readDirNode(node.children[i], child);
+  if (child.count < DIR_T) {
+    this->dirFill(node, block, i);
+  }
+  if (last && i > node.count) {
+    return this->dirRemoveFrom(node.children[i - 1], name);
+  }
+  return this->dirRemoveFrom(node.children[i], name);
+}
+
+void FS::dirFill(dirNode& parent, int parentBlock, int index) {
+  dirNode child;
+  this->readDirNode(parent.children[index], child);
+
+  //  pedir prestada una entrada al hermano izquierdo
+  if (index > 0) {
+    dirNode sibling;
+    this->readDirNode(parent.children[index - 1], sibling);
+    if (sibling.count >= DIR_T) {
+      for (int j = child.count - 1; j >= 0; j--) {
+        child.entries[j + 1] = child.entries[j];
+      }
+      if (!child.leaf) {
+        for (int j = child.count; j >= 0; j--) {
+          child.children[j + 1] = child.children[j];
+        }
+        child.children[0] = sibling.children[sibling.count];
+      }
+      child.entries[0] = parent.entries[index - 1];
+      parent.entries[index - 1] = sibling.entries[sibling.count - 1];
+      child.count++;
+      sibling.count--;
+
+      this->writeDirNode(parent.children[index - 1], sibling);
+      this->writeDirNode(parent.children[index], child);
+      this->writeDirNode(parentBlock, parent);
+      return;
+    }
+  }
+
+  //  pedir prestada una entrada al hermano derecho
+  if (index < parent.count) {
+    dirNode sibling;
+    this->readDirNode(parent.children[index + 1], sibling);
+    if (sibling.count >= DIR_T) {
+      child.entries[child.count] = parent.entries[index];
+      if (!child.leaf) {
+        child.children[child.count + 1] = sibling.children[0];
+      }
+      parent.entries[index] = sibling.entries[0];
+      for (int j = 1; j < sibling.count; j++) {
+        sibling.entries[j - 1] = sibling.entries[j];
+      }
+      if (!sibling.leaf) {
+        for (int j = 1; j <= sibling.count; j++) {
+          sibling.children[j - 1] = sibling.children[j];
+        }
+      }
+      child.count++;
+      sibling.count--;
+
+      this->writeDirNode(parent.children[index + 1], sibling);
+      this->writeDirNode(parent.children[index], child);
+      this->writeDirNode(parentBlock, parent);
+      return;
+    }
+  }
+
+  //  ningun hermano puede ceder: unir el hijo con su hermano derecho (o el izquierdo con el)
+  this->dirMerge(parent, parentBlock, index < parent.count ? index : index - 1);
+}
+
+void FS::dirMerge(dirNode& parent, int parentBlock, int index) {
+  //  hijo index + entrada index del padre + hijo index + 1 quedan en el hijo index
+  int leftBlock = parent.children[index];
+  int rightBlock = parent.children[index + 1];
+  dirNode left;
+  dirNode right;
+  this->readDirNode(leftBlock, left);
+  this->readDirNode(rightBlock, right);
+
+  left.entries[left.count] = parent.entries[index];
+  for (int j = 0; j < right.count; j++) {
+    left.entries[left.count + 1 + j] = right.entries[j];
+  }
+  if (!left.leaf) {
+    for (int j = 0; j <= right.count; j++) {
+      left.children[left.count + 1 + j] = right.children[j];
+    }
+  }
+  left.count += right.count + 1;
+
+  for (int j = index + 1; j < parent.count; j++) {
+    parent.entries[j - 1] = parent.entries[j];
+  }
+  for (int j = index + 2; j <= parent.count; j++) {
+    parent.children[j - 1] = parent.children[j];
+  }
+  parent.count--;
+
+  this->writeDirNode(leftBlock, left);
+  this->writeDirNode(parentBlock, parent);
+  this->releaseBlock(rightBlock);
+}
+
+void FS::dirForEach(int block, void (*visit)(void* context, const dirEntry& entry), void* context) {
+  dirNode node;
+  if (this->readDirNode(block, node) == -1) {
+    return;
+  }
+  for (int i = 0; i < node.count; i++) {
+    if (!node.leaf) {
+      this->dirForEach(node.children[i], visit, context);
+    }
+    visit(context, node.entries[i]);
+  }
+  if (!node.leaf) {
+    this->dirForEach(node.children[node.count], visit, context);
+  }
+}
+
+std::vector<int> FS::dirNodeBlocks(int root) {
+  std::vector<int> blocks;
+  std::vector<int> pendientes(1, root);
+  dirNode node;
+  while (!pendientes.empty()) {
+    int block = pendientes.back();
+    pendientes.pop_back();
+    blocks.push_back(block);
+    if (this->readDirNode(block, node) == 0 && !node.leaf) {
+      pendientes.insert(pendientes.end(), node.children, node.children + node.count + 1);
+    }
+  }
+  return blocks;
+}
@@ -0,0 +1,408 @@
+#include "../include/FS.h"
+#include <iostream>
+
+//  journal de rehacer: cada commit guarda en el journal la imagen nueva de los
+//  metadatos sucios, un solo sync la vuelve durable y recien despues se escribe
+//  en su lugar. Si el sistema se cae a mitad de camino, replayJournal vuelve a
+//  aplicar las transacciones completas y el bitmap, la tabla de inodos y el
+//  directorio quedan de acuerdo entre si
+
+//  FNV-1a de 64 bits, encadenable
+static uint64_t checksum(uint64_t h, const void* data, size_t size) {
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  for (size_t i = 0; i < size; i++) {
+    h ^= bytes[i];
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+static uint64_t transactionChecksum(const transactionHeader& header, const char* body, size_t size) {
+  uint64_t h = checksum(14695981039346656037ull, &header.sequence, sizeof(header.sequence));
+  return checksum(h, body, size);
+}
+
+//  transaccion de la ultima operacion que hizo saveChanges en este hilo; la
+//  espera el durableScope de la operacion publica que la contiene
+static thread_local uint64_t pendingTicket = 0;
+
+FS::durableScope::durableScope(FS* fs) : fs(fs), outer(pendingTicket) {
+  pendingTicket = 0;
+}
+
+FS::durableScope::~durableScope() {
+  if (pendingTicket != 0) {
+    this->fs->waitDurable(pendingTicket);
+  }
+  pendingTicket = this->outer;
+}
+
+void FS::saveChanges() {
+  pendingTicket = this->openTransaction;
+
+  //  lo que junta la transaccion en curso sin contar el superBlock ni el
+  //  bitmap; el journal tiene lugar para JOURNAL_BLOCKS de esto mas la peor
+  //  operacion que venga despues
+  size_t blocks = this->dirtyInodeBlocks.size() + this->dirtyMeta.size();
+  {
+    std::lock_guard<std::mutex> guard(this->checksumLock);
+    blocks += this->dirtyChecksumBlocks.size();
+  }
+
+  //  los bloques liberados no pasan a otro archivo hasta que la liberacion es
+  //  durable: si no, una caida deja al dueno anterior apuntando a datos ajenos
+  if (this->blocksFreed || blocks >= JOURNAL_BLOCKS) {
+    this->commit();
+  }
+}
+
+void FS::waitDurable(uint64_t ticket) {
+  //  el primero que llega hace el commit para todos; los que terminan mientras
+  //  tanto esperan y el siguiente lider junta sus transacciones en una sola
+  std::unique_lock<std::mutex> durable(this->durableLock);
+  while (this->durableSequence < ticket) {
+    if (this->leading) {
+      this->durableChanged.wait(durable);
+      continue;
+    }
+    this->leading = true;
+    durable.unlock();
+    {
+      std::unique_lock<std::mutex> meta(this->metaLock);
+      this->commit(&meta);
+    }
+    durable.lock();
+    this->leading = false;
+    this->durableChanged.notify_all();
+  }
+}
+
+int FS::journalSize() {
+  //  una operacion puede tocar enteras las tablas fijas: superBlock, bitmap,
+  //  cuentas de referencias, hashes, registros de snapshots y checksums
+  int tablas = 1 + this->bitMapBlocks + this->sb.refCountBlocks + this->sb.dedupBlocks + MAX_SNAPSHOTS +
+               this->sb.checksumBlocks;
+  //  y ademas renombrar saca y mete un nombre, cada uno con hasta tres nodos
+  //  por nivel del arbol; los inodos de dos archivos con el de la tabla; y los
+  //  bloques de extents de un archivo. Lo que asigna es fresco y no cuenta
+  int altura = 1;
+  for (long nodos = 1; nodos < (long)this->sb.TotalBlocks * this->inodesPerBlock; nodos *= (DIR_MAX_KEYS + 1) / 2) {
+    altura++;
+  }
+  int operacion = tablas + 6 * altura + 3 + 2 + this->sb.TotalBlocks / EXTENTS_PER_BLOCK;
+
+  //  cada bloque lleva un registro, y puede haber otro tanto de revocaciones
+  int datos = JOURNAL_BLOCKS + operacion;
+  size_t registros = sizeof(transactionHeader) + 2 * (size_t)datos * sizeof(journalRecord);
+  return 1 + datos + (registros + BLOCK_SIZE - 1) / BLOCK_SIZE;
+}
+
+int FS::sync() {
+  std::lock_guard<std::mutex> meta(this->metaLock);
+  return this->commit();
+}
+
+int FS::commit(std::unique_lock<std::mutex>* meta) {
+  //  un snapshot montado nunca cambia la imagen
+  if (this->readOnly) {
+    return 0;
+  }
+
+  //  el commit anterior termino de escribir: lo suyo ya esta en su lugar
+  std::unique_lock<std::mutex> io(this->commitLock);
+  this->committingMeta.clear();
+  uint64_t ticket = this->openTransaction++;
+  auto markDurable = [this, ticket]() {
+    {
+      std::lock_guard<std::mutex> guard(this->durableLock);
+      this->durableSequence = std::max(this->durableSequence, ticket);
+    }
+    this->durableChanged.notify_all();
+  };
+
+  //  todo se escribe en bloques enteros, asi el checksum de cada uno cubre
+  //  exactamente lo que queda en disco. Lo que sigue cambiando en memoria se
+  //  copia, porque la escritura puede seguir sin metaLock
+  std::vector<diskWrite> writes;
+  std::vector<std::vector<char>> images;
+
+  //  superBlock en bloque 0, solo si algun campo cambio
+  if (memcmp(&this->sb, &this->savedSb, sizeof(superBlock)) != 0) {
+    memcpy(&this->savedSb, &this->sb, sizeof(superBlock));
+    images.emplace_back(BLOCK_SIZE, 0);
+    memcpy(images.back().data(), &this->savedSb, sizeof(superBlock));
+    writes.push_back({0, images.back().data(), BLOCK_SIZE});
+  }
+
+  //  bloques del bitmap que contienen alguna palabra modificada; el ultimo se
+  //  completa con ceros
+  std::vector<size_t> words;
+  this->bitMap.takeDirtyWords(words);
+  size_t wordsPerBlock = BLOCK_SIZE / sizeof(uint64_t);
+  long lastBlock = -1;
+  for (size_t word : words) {
+    long block = word / wordsPerBlock;
+    if (block != lastBlock) {
+      const char* source = reinterpret_cast<const char*>(this->bitMap.data()) + block * BLOCK_SIZE;
+      size_t bytes = std::min((size_t)BLOCK_SIZE, this->bitMap.bytes() - block * BLOCK_SIZE);
+      images.emplace_back(BLOCK_SIZE, 0);
+      memcpy(images.back().data(), source, bytes);
+      writes.push_back({(size_t)(this->bitMapStart + block) * BLOCK_SIZE, images.back().data(), BLOCK_SIZE});
+      lastBlock = block;
+    }
+  }
+
+  //  bloques de la tabla de inodos con algun inode cambiado
+  for (int b : this->dirtyInodeBlocks) {
+    const char* source = reinterpret_cast<const char*>(this->inodesTable[b].data());
+    images.emplace_back(source, source + this->inodesPerBlock * sizeof(inode));
+    writes.push_back({(size_t)this->mapBlock(INODE_TABLE_NUMBER, b) * BLOCK_SIZE,
+        images.back().data(), images.back().size()});
+  }
+
+  //  nodos del directorio y bloques indirectos tocados
+  this->committingMeta.swap(this->dirtyMeta);
+  for (const auto& meta : this->committingMeta) {
+    writes.push_back({(size_t)meta.first * BLOCK_SIZE, meta.second.data(), BLOCK_SIZE});
+  }
+
+  //  los checksums de todo lo anterior y los bloques de la tabla que
+  //  cambiaron, tambien los de escrituras de datos, van en la misma transaccion
+  std::vector<checksumBlock> checksumImages;
+  this->checksumWrites(writes, checksumImages);
+
+  //  un bloque liberado y vuelto a usar como metadato en la misma transaccion
+  //  lleva su imagen nueva, que ya reemplaza a las anteriores
+  std::vector<int> revokes;
+  for (int block : this->revokedBlocks) {
+    if (!this->committingMeta.count(block)) {
+      revokes.push_back(block);
+    }
+  }
+  auto transactionBlocks = [&](const std::vector<diskWrite>& ws) {
+    size_t bytes = sizeof(transactionHeader) + (ws.size() + revokes.size()) * sizeof(journalRecord);
+    for (const diskWrite& w : ws) {
+      bytes += w.size;
+    }
+    return (int)((bytes + BLOCK_SIZE - 1) / BLOCK_SIZE);
+  };
+
+  std::unordered_set<int> fresh;
+  fresh.swap(this->freshBlocks);
+  this->releasedBlocks.clear();
+  this->revokedBlocks.clear();
+  this->dirtyInodeBlocks.clear();
+  bool frees = this->blocksFreed;
+  this->blocksFreed = false;
+  if (writes.empty() && revokes.empty()) {
+    markDurable();
+    return 0;
+  }
+
+  //  si no entra en el journal, los bloques frescos (la tabla de inodos que
+  //  crecio, las copias de un snapshot) van primero en su lugar con su propio
+  //  sync: la imagen durable no los usa, asi que una caida antes del commit no
+  //  pierde nada. Al journal van solo los que ya estaban en uso
+  std::vector<diskWrite> ordered;
+  if (transactionBlocks(writes) > this->sb.journalBlocks - 1) {
+    std::vector<diskWrite> journaled;
+    for (const diskWrite& w : writes) {
+      (fresh.count(w.offset / BLOCK_SIZE) ? ordered : journaled).push_back(w);
+    }
+    writes.swap(journaled);
+  }
+
+  std::vector<journalRecord> records;
+  size_t payloadBytes = 0;
+  for (const diskWrite& w : writes) {
+    records.push_back({w.offset, (uint32_t)w.size, RECORD_WRITE});
+    payloadBytes += w.size;
+  }
+  for (int block : revokes) {
+    records.push_back({(uint64_t)block, 0, RECORD_REVOKE});
+  }
+  int blocks = transactionBlocks(writes);
+  if (blocks > this->sb.journalBlocks - 1) {
+    //  journalSize deja lugar para la peor operacion: esto no deberia pasar, y
+    //  escribir en su lugar sin el journal podria dejar la imagen a medias
+    std::cout << "La transaccion no entra en el journal\n";
+    markDurable();
+    return -1;
+  }
+
+  //  el lugar en el journal se decide ahora; si no entra detras de las
+  //  anteriores, el journal empieza de nuevo despues de un sync de todo
+  bool restart = this->journalFailed || this->journalHead == 0 ||
+                 this->journalHead + blocks > this->sb.journalBlocks;
+  this->journalFailed = false;
+  std::vector<char> journalStartBlock;
+  if (restart) {
+    journalStartBlock.assign(BLOCK_SIZE, 0);
+    journalHeader header = {JOURNAL_MAGIC, 0, this->journalSequence};
+    memcpy(journalStartBlock.data(), &header, sizeof(journalHeader));
+    this->journalHead = 1;
+    this->journaledBlocks.clear();
+  }
+  size_t offset = (size_t)(this->sb.journalStart + this->journalHead) * BLOCK_SIZE;
+  this->journalHead += blocks;
+  for (const diskWrite& w : writes) {
+    if (this->committingMeta.count(w.offset / BLOCK_SIZE)) {
+      this->journaledBlocks.insert(w.offset / BLOCK_SIZE);
+    }
+  }
+
+  //  encabezado, registros y datos seguidos en los bloques de la transaccion
+  std::vector<char> transaction((size_t)blocks * BLOCK_SIZE, 0);
+  transactionHeader header = {JOURNAL_MAGIC, (uint32_t)records.size(), this->journalSequence++,
+      (uint32_t)blocks, (uint32_t)payloadBytes, 0};
+  char* body = transaction.data() + sizeof(transactionHeader);
+  char* cursor = body;
+  memcpy(cursor, records.data(), records.size() * sizeof(journalRecord));
+  cursor += records.size() * sizeof(journalRecord);
+  for (const diskWrite& w : writes) {
+    memcpy(cursor, w.buffer, w.size);
+    cursor += w.size;
+  }
+  header.checksum = transactionChecksum(header, body, cursor - body);
+  memcpy(transaction.data(), &header, sizeof(transactionHeader));
+
+  //  desde aqui solo se escribe lo ya copiado, y otras operaciones pueden
+  //  seguir. Con bloques liberados no: hasta que la liberacion sea durable
+  //  nadie debe poder reusarlos
+  bool unlocked = meta != nullptr && !frees;
+  if (unlocked) {
+    meta->unlock();
+  }
+
+  //  el sync de los bloques frescos sirve tambien para el checkpoint: lo que
+  //  los commits anteriores escribieron en su lugar queda durable, asi que sus
+  //  transacciones ya no hacen falta. El encabezado nuevo se vuelve durable
+  //  con el sync de la transaccion; si no llega a escribirse, las transacciones
+  //  nuevas no siguen la numeracion del encabezado viejo y replayJournal se
+  //  detiene antes de ellas
+  int result = 0;
+  if ((!ordered.empty() && this->disk->writeBatch(ordered) == -1) ||
+      ((!ordered.empty() || restart) && this->disk->sync() == -1) ||
+      (restart && this->disk->write((size_t)this->sb.journalStart * BLOCK_SIZE,
+                                    journalStartBlock.data(), BLOCK_SIZE) == -1)) {
+    this->journalFailed = true;
+    result = -1;
+  }
+
+  //  el unico sync de un commit comun: desde aqui la transaccion sobrevive a una caida
+  if (result == 0 && (this->disk->write(offset, transaction.data(), transaction.size()) == -1 ||
+                      this->disk->sync() == -1)) {
+    std::cout << "No se pudo escribir el journal\n";
+    this->journalFailed = true;
+    result = -1;
+  }
+  //  en su lugar sin sync; el proximo checkpoint lo hace durable
+  if (result == 0) {
+    result = this->disk->writeBatch(writes);
+  }
+  markDurable();
+  io.unlock();
+
+  if (unlocked) {
+    meta->lock();
+  }
+  if (result == -1) {
+    std::cout << "No se pudo escribir en el disco\n";
+  } else if (frees) {
+    //  la liberacion ya es durable: si se rehace el journal los bloques siguen libres
+    this->discardFreedBlocks();
+  }
+  return result;
+}
+
+int FS::checkpoint() {
+  //  todo lo que los commits anteriores escribieron en su lugar queda durable,
+  //  asi que sus transacciones ya no hacen falta
+  std::lock_guard<std::mutex> io(this->commitLock);
+  if (this->disk->sync() == -1) {
+    return -1;
+  }
+
+  //  el encabezado nuevo se vuelve durable con el sync del siguiente commit; si
+  //  no llega a escribirse, las transacciones nuevas no siguen la numeracion del
+  //  encabezado viejo y replayJournal se detiene antes de ellas
+  std::vector<char> block(BLOCK_SIZE, 0);
+  journalHeader header = {JOURNAL_MAGIC, 0, this->journalSequence};
+  memcpy(block.data(), &header, sizeof(journalHeader));
+  this->journalHead = 1;
+  this->journaledBlocks.clear();
+  return this->disk->write((size_t)this->sb.journalStart * BLOCK_SIZE, block.data(), BLOCK_SIZE);
+}
+
+int FS::replayJournal() {
+  journalHeader header;
+  if (this->disk->read((size_t)this->sb.journalStart * BLOCK_SIZE, &header, sizeof(journalHeader)) == -1) {
+    return -1;
+  }
+  if (header.magic != JOURNAL_MAGIC) {
+    return 0;
+  }
+
+  //  primera pasada: transacciones completas y consecutivas, y la ultima
+  //  transaccion que revoco cada bloque
+  std::vector<std::vector<char>> transactions;
+  std::unordered_map<uint64_t, uint64_t> revoked;
+  uint64_t sequence = header.firstSequence;
+  int block = 1;
+  while (block < this->sb.journalBlocks) {
+    transactionHeader th;
+    size_t offset = (size_t)(this->sb.journalStart + block) * BLOCK_SIZE;
+    if (this->disk->read(offset, &th, sizeof(transactionHeader)) == -1 ||
+        th.magic != JOURNAL_MAGIC || th.sequence != sequence ||
+        th.blocks == 0 || block + (int)th.blocks > this->sb.journalBlocks) {
+      break;
+    }
+
+    std::vector<char> transaction((size_t)th.blocks * BLOCK_SIZE);
+    size_t bytes = sizeof(transactionHeader) + (size_t)th.recordCount * sizeof(journalRecord) + th.payloadBytes;
+    if (bytes > transaction.size() ||
+        this->disk->read(offset, transaction.data(), transaction.size()) == -1 ||
+        transactionChecksum(th, transaction.data() + sizeof(transactionHeader),
+            bytes - sizeof(transactionHeader)) != th.checksum) {
+      break;
+    }
+
+    const journalRecord* records = reinterpret_cast<const journalRecord*>(transaction.data() + sizeof(transactionHeader));
+    for (uint32_t r = 0; r < th.recordCount; r++) {
+      if (records[r].type == RECORD_REVOKE) {
+        revoked[records[r].offset] = th.sequence;
+      }
+    }
+    transactions.push_back(std::move(transaction));
+    block += th.blocks;
+    sequence++;
+  }
+
+  //  segunda pasada: rehacer en orden las escrituras que nadie revoco despues
+  for (const std::vector<char>& transaction : transactions) {
+    const transactionHeader* th = reinterpret_cast<const transactionHeader*>(transaction.data());
+    const journalRecord* records = reinterpret_cast<const journalRecord*>(transaction.data() + sizeof(transactionHeader));
+    const char* payload = reinterpret_cast<const char*>(records + th->recordCount);
+    for (uint32_t r = 0; r < th->recordCount; r++) {
+      if (records[r].type != RECORD_WRITE) {
+        continue;
+      }
+      auto revocation = revoked.find(records[r].offset / BLOCK_SIZE);
+      bool skip = revocation != revoked.end() && revocation->second >= th->sequence;
+      if (!skip && records[r].offset + records[r].size <= this->disk->size() &&
+          this->disk->write(records[r].offset, payload, records[r].size) == -1) {
+        return -1;
+      }
+      payload += records[r].size;
+    }
+  }
+  if (!transactions.empty() && this->disk->sync() == -1) {
+    return -1;
+  }
+
+  //  lo aplicado ya esta en su lugar: el siguiente commit reinicia el journal
+  this->journalSequence = sequence;
+  this->journalHead = 0;
+  this->journaledBlocks.clear();
+  return transactions.size();
+}
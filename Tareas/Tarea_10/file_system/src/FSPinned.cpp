@@ -0,0 +1,168 @@
+#include "../include/FS.h"
+#include <iostream>
+
+//  lecturas sin copias: en lugar de copiar los bloques a un buffer de quien
+//  llama se dejan fijos en la cache y se entregan spans sobre sus frames, que
+//  se pueden pasar tal cual a writev o a un socket. Un frame fijo no se
+//  reemplaza pero si se actualiza con las escrituras (la cache es
+//  write-through), por eso el bloque tampoco puede pasar a otro archivo antes
+//  del release: releaseBlock lo deja en pinHolder hasta entonces
+
+long FS::readPinned(const std::string& name, size_t offset, size_t size, pinnedRead& out) {
+  this->release(out);
+  std::shared_lock<std::shared_mutex> dir(this->dirLock);
+  int index = this->lookup(name);
+  if (index == -1) {
+    std::cout << "File \"" << name << "\" does not exist." << std::endl;
+    return -1;
+  }
+
+  std::shared_lock<std::shared_mutex> file(this->inodeLock(index));
+  size_t fileSize = this->sizeOf(index);
+  if (offset >= fileSize || size == 0) {
+    return 0;
+  }
+  long pinned = this->pinRange(index, offset, std::min(size, fileSize - offset), out);
+  //  todavia con el lock del archivo, asi ningun bloque se libero entre el pin y aqui
+  {
+    std::lock_guard<std::mutex> meta(this->metaLock);
+    for (size_t block : out.pinned) {
+      this->pinCounts[block]++;
+    }
+  }
+  if (pinned == -1) {
+    this->release(out);
+  }
+  return pinned;
+}
+
+void FS::release(pinnedRead& read) {
+  if (!read.pinned.empty()) {
+    std::lock_guard<std::mutex> meta(this->metaLock);
+    for (size_t block : read.pinned) {
+      auto count = this->pinCounts.find(block);
+      if (--count->second > 0) {
+        continue;
+      }
+      this->pinCounts.erase(count);
+      if (this->pinnedFreed.erase(block) && this->unheldBlocks.erase(block)) {
+        this->releaseBlock(block);
+      }
+    }
+    if (this->pinnedFreed.empty() && this->pinHolder != -1) {
+      this->releaseOrphan(this->pinHolder);
+      this->pinHolder = -1;
+    }
+    this->saveChanges();
+  }
+  this->unpinAll(read);
+}
+
+void FS::unpinAll(pinnedRead& read) {
+  for (size_t block : read.pinned) {
+    this->disk->unpin(block);
+  }
+  read.spans.clear();
+  read.pinned.clear();
+  read.copies.clear();
+}
+
+bool FS::deferRelease(int block) {
+  if (!this->pinCounts.count(block)) {
+    return false;
+  }
+  //  con el contenido guardado en el frame, dedup no debe ofrecerlo a otro archivo
+  this->forgetHash(block);
+  this->pinnedFreed.insert(block);
+  if (this->pinHolder == -1) {
+    this->pinHolder = this->allocateOrphan(false, false);
+  }
+  if (this->pinHolder == -1 || this->appendExtent(this->pinHolder, extent{block, 1}) == -1) {
+    this->unheldBlocks.insert(block);
+  }
+  return true;
+}
+
+long FS::pinRange(int index, size_t offset, size_t size, pinnedRead& out) {
+  size_t blockSize = this->sb.blockSize;
+  size = std::min(size, PIN_MAX_BLOCKS * blockSize - offset % blockSize);
+
+  //  inline o comprimido no hay un frame con los bytes del archivo tal cual
+  bool copy;
+  std::shared_ptr<const blockMap> map;
+  std::vector<extent> ahead;
+  {
+    std::lock_guard<std::mutex> meta(this->metaLock);
+    const inode& node = this->inodeAt(index);
+    copy = isInline(node) || node.compressed;
+    if (!copy) {
+      map = this->getBlockMap(index);
+      ahead = this->readAhead(index, offset, size, *map);
+    }
+  }
+  if (copy) {
+    out.copies.emplace_back(size);
+    if (this->readDisk(index, offset, out.copies.back().data(), size) == -1) {
+      return -1;
+    }
+    out.spans.push_back(std::span<const char>(out.copies.back().data(), size));
+    return size;
+  }
+
+  //  los tramos del disco que cubren el rango, como en readStream
+  std::vector<diskRead> pieces;
+  size_t end = offset + size;
+  size_t position = offset;
+  for (size_t i = 0; i < map->extents.size() && position < end; i++) {
+    size_t extentStart = (size_t)map->firstLogical[i] * blockSize;
+    size_t extentEnd = extentStart + (size_t)map->extents[i].length * blockSize;
+    if (extentEnd <= position) {
+      continue;
+    }
+    size_t porLeer = std::min(extentEnd, end) - position;
+    pieces.push_back({(size_t)map->extents[i].start * blockSize + (position - extentStart), nullptr, porLeer});
+    position += porLeer;
+  }
+  if (position != end) {
+    return -1;
+  }
+
+  //  todo lo que falta se pide junto y sin esperar; pin espera los bloques que
+  //  ya vienen en camino en vez de leerlos de a uno
+  for (const diskRead& piece : pieces) {
+    this->disk->prefetch(piece.offset, piece.size);
+  }
+  for (const extent& e : ahead) {
+    this->disk->prefetch((size_t)e.start * blockSize, (size_t)e.length * blockSize);
+  }
+
+  for (const diskRead& piece : pieces) {
+    for (size_t pos = piece.offset; pos < piece.offset + piece.size;) {
+      size_t block = pos / blockSize;
+      size_t n = std::min(blockSize - pos % blockSize, piece.offset + piece.size - pos);
+      const char* source;
+      const char* frame = this->disk->pin(block);
+      if (frame != nullptr) {
+        out.pinned.push_back(block);
+        source = frame + pos % blockSize;
+      } else {
+        //  danado o con todos los frames fijos: read reporta lo primero y
+        //  en lo segundo se copia como cualquier lectura
+        out.copies.emplace_back(n);
+        if (this->disk->read(pos, out.copies.back().data(), n) == -1) {
+          return -1;
+        }
+        source = out.copies.back().data();
+      }
+
+      //  frames vecinos en memoria quedan en un solo span
+      if (!out.spans.empty() && out.spans.back().data() + out.spans.back().size() == source) {
+        out.spans.back() = std::span<const char>(out.spans.back().data(), out.spans.back().size() + n);
+      } else {
+        out.spans.push_back(std::span<const char>(source, n));
+      }
+      pos += n;
+    }
+  }
+  return size;
+}
@@ -0,0 +1,332 @@
+#include "../include/FS.h"
+#include <iostream>
+
+//  snapshots: un snapshot es un superBlock congelado cuya tabla de inodos,
+//  directorio y bloques de extents son copias propias, mas una copia del
+//  bitmap. Los bloques de datos no se copian: cada uno suma un dueno en
+//  refCounts, como con clone, y el sistema vivo pasa a un bloque propio el que
+//  quiera reescribir (breakSharing) o reemplaza el bloque entero (dedup). Asi
+//  tomar un snapshot solo escribe metadatos y borrarlo solo saca duenos.
+//  Los registros viven en MAX_SNAPSHOTS bloques despues de los hashes de dedup
+
+int FS::snapshot(const std::string& name) {
+  if (this->refuseWrite()) {
+    return -1;
+  }
+  if (name.empty() || name.size() >= MAX_NAME_LENGTH) {
+    std::cout << "Nombre de snapshot invalido" << std::endl;
+    return -1;
+  }
+
+  //  con dirLock exclusivo no hay ninguna operacion en curso, como en scrub;
+  //  los que escriben esperan solo lo que dura copiar los metadatos
+  std::unique_lock<std::shared_mutex> dir(this->dirLock);
+  std::lock_guard<std::mutex> meta(this->metaLock);
+  snapshotRecord record;
+  if (this->findSnapshot(name, record) != -1) {
+    std::cout << "Snapshot \"" << name << "\" already exists." << std::endl;
+    return -1;
+  }
+  int slot = -1;
+  for (int s = 0; s < MAX_SNAPSHOTS && slot == -1; s++) {
+    if (this->readMeta(this->sb.snapshotStart + s, 0, &record, sizeof(snapshotRecord)) == 0 && !record.active) {
+      slot = s;
+    }
+  }
+  if (slot == -1) {
+    std::cout << "Ya hay " << MAX_SNAPSHOTS << " snapshots" << std::endl;
+    return -1;
+  }
+
+  //  lo que se congela es el estado de antes de hacer las copias
+  this->loadBitMap();
+  std::vector<char> frozenBitMap((size_t)this->bitMapBlocks * BLOCK_SIZE, 0);
+  memcpy(frozenBitMap.data(), this->bitMap.data(), this->bitMap.bytes());
+  superBlock frozen = this->sb;
+  //  la tabla del snapshot se arma desde cero mas abajo
+  this->resetExtents(frozen.inodeTable);
+
+  //  metadatos que se copian: los nodos del directorio y los bloques de
+  //  extents de cada archivo; los del indirecto doble guardan punteros
+  std::vector<int> dirBlocks = this->dirNodeBlocks(this->sb.dirRoot);
+  std::vector<int> extentBlocks;
+  std::vector<int> pointerBlocks;
+  std::vector<int> punteros(POINTERS_PER_BLOCK);
+  for (int i = 0; i < this->sb.maxInodes; i++) {
+    const inode& node = this->inodeAt(i);
+    if (!node.active) {
+      continue;
+    }
+    if (node.indirectBlocks[0] != -1) {
+      extentBlocks.push_back(node.indirectBlocks[0]);
+    }
+    if (node.indirectBlocks[1] != -1) {
+      pointerBlocks.push_back(node.indirectBlocks[1]);
+      this->readMeta(node.indirectBlocks[1], 0, punteros.data(), BLOCK_SIZE);
+      for (int p : punteros) {
+        if (p != -1) {
+          extentBlocks.push_back(p);
+        }
+      }
+    }
+  }
+
+  //  antes de tocar nada, que alcance todo: la tabla nueva puede necesitar
+  //  sus propios bloques indirectos si queda en mas de EXTENT_COUNT extents
+  int tableBlocks = this->sb.maxInodes / this->inodesPerBlock;
+  int tableIndex = tableBlocks > EXTENT_COUNT ? 2 + (tableBlocks - EXTENT_COUNT) / EXTENTS_PER_BLOCK : 0;
+  int needed = this->bitMapBlocks + dirBlocks.size() + extentBlocks.size() + pointerBlocks.size() +
+               tableBlocks + tableIndex;
+  if (needed > this->sb.freeBlocks) {
+    std::cout << "Insufficient space to store this snapshot" << std::endl;
+    return -1;
+  }
+
+  //  el bitmap va seguido y es lo unico que puede faltar con bloques libres de
+  //  sobra; se pide primero, asi si falla nada cambio
+  int bitMapCopy;
+  try {
+    bitMapCopy = this->findFreeBlock(this->bitMapBlocks, 1)[0].start;
+  } catch (const std::runtime_error&) {
+    std::cout << "Insufficient space to store this snapshot" << std::endl;
+    return -1;
+  }
+  for (int b = 0; b < this->bitMapBlocks; b++) {
+    this->writeMeta(bitMapCopy + b, 0, frozenBitMap.data() + (size_t)b * BLOCK_SIZE, BLOCK_SIZE);
+  }
+
+  //  si algo falla de aqui en adelante se devuelve todo lo pedido: la copia
+  //  del bitmap, las de los metadatos, la tabla y sus bloques indirectos
+  std::unordered_map<int, int> copies;
+  std::vector<extent> tabla;
+  auto deshacer = [&]() {
+    for (int b = 0; b < this->bitMapBlocks; b++) {
+      this->releaseBlock(bitMapCopy + b);
+    }
+    for (const auto& copy : copies) {
+      this->releaseBlock(copy.second);
+    }
+    for (const extent& e : tabla) {
+      for (int b = e.start; b < e.start + e.length; b++) {
+        this->releaseBlock(b);
+      }
+    }
+    this->releaseIndirectBlocks(frozen.inodeTable);
+    std::cout << "Insufficient space to store this snapshot" << std::endl;
+    return -1;
+  };
+
+  //  primero un bloque para cada copia y despues el contenido, con los
+  //  punteros traducidos a las copias
+  int goal = bitMapCopy + this->bitMapBlocks;
+  try {
+    for (const std::vector<int>* blocks : {&dirBlocks, &pointerBlocks, &extentBlocks}) {
+      for (int block : *blocks) {
+        int copy = this->findFreeBlock(1, 1, goal)[0].start;
+        copies[block] = copy;
+        goal = copy + 1;
+      }
+    }
+  } catch (const std::runtime_error&) {
+    return deshacer();
+  }
+  auto copyOf = [&](int block) {
+    return block == -1 ? -1 : copies.at(block);
+  };
+
+  std::vector<char> image(BLOCK_SIZE);
+  for (int block : extentBlocks) {
+    this->readMeta(block, 0, image.data(), BLOCK_SIZE);
+    this->writeMeta(copies[block], 0, image.data(), BLOCK_SIZE);
+  }
+  for (int block : pointerBlocks) {
+    this->readMeta(block, 0, punteros.data(), BLOCK_SIZE);
+    for (int& p : punteros) {
+      p = copyOf(p);
+    }
+    this->writeMeta(copies[block], 0, punteros.data(), BLOCK_SIZE);
+  }
+  for (int block : dirBlocks) {
+    dirNode node;
+    this->readDirNode(block, node);
+    if (!node.leaf) {
+      for (int i = 0; i <= node.count; i++) {
+        node.children[i] = copyOf(node.children[i]);
+      }
+    }
+    this->writeDirNode(copies[block], node);
+  }
+  frozen.dirRoot = copyOf(this->sb.dirRoot);
+
+  //  la tabla de inodos del snapshot es otro archivo con los mismos inodos
+  try {
+    tabla = this->findFreeBlock(tableBlocks, MAX_EXTENTS, goal);
+  } catch (const std::runtime_error&) {
+    return deshacer();
+  }
+  for (size_t slot = 0; slot < tabla.size(); slot++) {
+    if (this->writeExtentSlot(frozen.inodeTable, slot, tabla[slot]) == -1) {
+      return deshacer();
+    }
+  }
+  frozen.inodeTable.extentCount = tabla.size();
+
+  std::vector<inode> inodos(this->inodesPerBlock);
+  int t = 0;
+  for (const extent& e : tabla) {
+    for (int b = e.start; b < e.start + e.length; b++, t++) {
+      for (int k = 0; k < this->inodesPerBlock; k++) {
+        inodos[k] = this->inodeAt(t * this->inodesPerBlock + k);
+        if (inodos[k].active) {
+          inodos[k].indirectBlocks[0] = copyOf(inodos[k].indirectBlocks[0]);
+          inodos[k].indirectBlocks[1] = copyOf(inodos[k].indirectBlocks[1]);
+        }
+      }
+      this->writeMeta(b, 0, inodos.data(), BLOCK_SIZE);
+    }
+  }
+
+  //  los bloques de datos quedan con un dueno mas
+  for (int i = 0; i < this->sb.maxInodes; i++) {
+    if (!this->inodeAt(i).active) {
+      continue;
+    }
+    for (const extent& e : this->getBlockMap(i)->extents) {
+      for (int b = e.start; b < e.start + e.length; b++) {
+        this->shareBlock(b);
+      }
+    }
+  }
+
+  record = snapshotRecord{};
+  record.active = 1;
+  strncpy(record.name, name.c_str(), MAX_NAME_LENGTH - 1);
+  strncpy(record.date, this->getActualDate().c_str(), MAX_DATE_LENGTH - 1);
+  record.bitMapStart = bitMapCopy;
+  record.sb = frozen;
+  this->writeMeta(this->sb.snapshotStart + slot, 0, &record, sizeof(snapshotRecord));
+
+  //  el snapshot es durable cuando retorna, tambien en su lugar: montarlo no
+  //  rehace el journal, asi que lo que solo estuviera ahi no se veria
+  if (this->commit() == -1 || this->checkpoint() == -1) {
+    return -1;
+  }
+  return 0;
+}
+
+int FS::deleteSnapshot(const std::string& name) {
+  if (this->refuseWrite()) {
+    return -1;
+  }
+  std::unique_lock<std::shared_mutex> dir(this->dirLock);
+  std::lock_guard<std::mutex> meta(this->metaLock);
+  snapshotRecord record;
+  int slot = this->findSnapshot(name, record);
+  if (slot == -1) {
+    std::cout << "Snapshot \"" << name << "\" does not exist." << std::endl;
+    return -1;
+  }
+  this->loadBitMap();
+
+  //  cada archivo del snapshot devuelve sus duenos y sus bloques de extents;
+  //  un bloque de datos que el sistema vivo ya no usa queda libre
+  std::vector<extent> tabla;
+  if (this->loadExtents(record.sb.inodeTable, tabla) == -1) {
+    return -1;
+  }
+  std::vector<inode> inodos(this->inodesPerBlock);
+  std::vector<extent> extents;
+  for (const extent& e : tabla) {
+    for (int b = e.start; b < e.start + e.length; b++) {
+      this->readMeta(b, 0, inodos.data(), BLOCK_SIZE);
+      for (const inode& node : inodos) {
+        if (!node.active) {
+          continue;
+        }
+        this->loadExtents(node, extents);
+        for (const extent& datos : extents) {
+          for (int d = datos.start; d < datos.start + datos.length; d++) {
+            this->releaseBlock(d);
+          }
+        }
+        this->releaseIndirectBlocks(node);
+      }
+      this->releaseBlock(b);
+    }
+  }
+  this->releaseIndirectBlocks(record.sb.inodeTable);
+  for (int block : this->dirNodeBlocks(record.sb.dirRoot)) {
+    this->releaseBlock(block);
+  }
+  for (int b = 0; b < this->bitMapBlocks; b++) {
+    this->releaseBlock(record.bitMapStart + b);
+  }
+
+  record = snapshotRecord{};
+  this->writeMeta(this->sb.snapshotStart + slot, 0, &record, sizeof(snapshotRecord));
+  if (this->commit() == -1 || this->checkpoint() == -1) {
+    return -1;
+  }
+  return 0;
+}
+
+std::vector<std::string> FS::snapshots() {
+  std::lock_guard<std::mutex> meta(this->metaLock);
+  std::vector<std::string> names;
+  snapshotRecord record;
+  for (int s = 0; s < MAX_SNAPSHOTS; s++) {
+    if (this->readMeta(this->sb.snapshotStart + s, 0, &record, sizeof(snapshotRecord)) == 0 && record.active) {
+      names.push_back(std::string(record.name) + " (" + record.date + ")");
+    }
+  }
+  return names;
+}
+
+int FS::findSnapshot(const std::string& name, snapshotRecord& record) {
+  for (int s = 0; s < MAX_SNAPSHOTS; s++) {
+    if (this->readMeta(this->sb.snapshotStart + s, 0, &record, sizeof(snapshotRecord)) == 0 &&
+        record.active && strncmp(record.name, name.c_str(), MAX_NAME_LENGTH) == 0) {
+      return s;
+    }
+  }
+  return -1;
+}
+
+bool FS::refuseWrite() {
+  if (this->readOnly) {
+    std::cout << "El snapshot montado es de solo lectura" << std::endl;
+  }
+  return this->readOnly;
+}
+
+int FS::mountSnapshot(const std::string& name) {
+  std::unique_lock<std::shared_mutex> dir(this->dirLock);
+  std::lock_guard<std::mutex> meta(this->metaLock);
+  superBlock stored;
+  if (this->disk->read(0, &stored, sizeof(superBlock)) == -1 || stored.magic != FS_MAGIC ||
+      stored.version != FS_VERSION || stored.blockSize != BLOCK_SIZE) {
+    return -1;
+  }
+
+  //  sin rehacer el journal: eso escribiria la imagen. snapshot y
+  //  deleteSnapshot hacen un checkpoint antes de retornar, asi lo que se lee
+  //  en su lugar ya esta completo
+  this->resetState();
+  this->sb = stored;
+  snapshotRecord record;
+  if (this->findSnapshot(name, record) == -1 || this->loadChecksums() == -1) {
+    return -1;
+  }
+
+  //  desde aqui todo se lee a traves del superBlock congelado
+  this->sb = record.sb;
+  memcpy(&this->savedSb, &this->sb, sizeof(superBlock));
+  this->computeLayout();
+  this->bitMapStart = record.bitMapStart;
+  this->bitMap.resize(this->sb.TotalBlocks);
+  this->bitMap.markClean();
+  this->bitMapLoaded = false;
+  this->inodesTable.resize(this->sb.maxInodes / this->inodesPerBlock);
+  this->readOnly = true;
+  return 0;
+}
@@ -0,0 +1,146 @@
+#include "../include/FileDisk.h"
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+FileDisk::FileDisk(const std::string& path, size_t size) {
+  this->fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+  if (this->fd == -1) {
+    throw std::runtime_error("FileDisk: could not create " + path + ": " + std::strerror(errno));
+  }
+
+  this->diskSize = size;
+
+  //  asegurar que el archivo tenga el tamano correcto; ftruncate lo deja disperso,
+  //  asi una imagen grande se crea sin escribir nada y sin ocupar espacio en el host
+  struct stat st;
+  if (::fstat(this->fd, &st) == -1 || (size_t)st.st_size < size) {
+    if (::ftruncate(this->fd, size) == -1) {
+      ::close(this->fd);
+      throw std::runtime_error("FileDisk: ftruncate failed: " + std::string(std::strerror(errno)));
+    }
+  }
+  this->engine = IOEngine::create();
+}
+
+FileDisk::~FileDisk() {
+  delete this->engine;
+  ::close(this->fd);
+}
+
+int FileDisk::read(size_t offset, void* buffer, size_t size) {
+  if (offset + size > this->diskSize) {
+    return -1;
+  }
+
+  char* destino = static_cast<char*>(buffer);
+  while (size > 0) {
+    ssize_t leidos = ::pread(this->fd, destino, size, offset);
+    if (leidos <= 0) {
+      if (leidos == -1 && errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    destino += leidos;
+    offset += leidos;
+    size -= leidos;
+  }
+  return 0;
+}
+
+int FileDisk::write(size_t offset, const void* buffer, size_t size) {
+  if (offset + size > this->diskSize) {
+    return -1;
+  }
+
+  const char* origen = static_cast<const char*>(buffer);
+  while (size > 0) {
+    ssize_t escritos = ::pwrite(this->fd, origen, size, offset);
+    if (escritos <= 0) {
+      if (escritos == -1 && errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    origen += escritos;
+    offset += escritos;
+    size -= escritos;
+  }
+  return 0;
+}
+
+int FileDisk::writeBatch(std::vector<diskWrite>& writes) {
+  std::vector<ioRequest> batch;
+  batch.reserve(writes.size());
+  for (const diskWrite& w : writes) {
+    if (w.offset + w.size > this->diskSize) {
+      return -1;
+    }
+    batch.push_back({this->fd, w.offset, const_cast<void*>(w.buffer), w.size, true, false});
+  }
+  return this->engine->run(batch);
+}
+
+int FileDisk::readBatch(std::vector<diskRead>& reads) {
+  std::vector<ioRequest> batch;
+  batch.reserve(reads.size());
+  for (const diskRead& r : reads) {
+    if (r.offset + r.size > this->diskSize) {
+      return -1;
+    }
+    batch.push_back({this->fd, r.offset, r.buffer, r.size, false, false});
+  }
+  return this->engine->run(batch);
+}
+
+void FileDisk::readAsync(std::vector<diskRead> reads, std::function<void(int)> done) {
+  std::vector<ioRequest> batch;
+  batch.reserve(reads.size());
+  for (const diskRead& r : reads) {
+    if (r.offset + r.size > this->diskSize) {
+      done(-1);
+      return;
+    }
+    batch.push_back({this->fd, r.offset, r.buffer, r.size, false, false});
+  }
+  this->engine->submit(batch, std::move(done));
+}
+
+void FileDisk::writeAsync(std::vector<diskWrite> writes, std::function<void(int)> done) {
+  std::vector<ioRequest> batch;
+  batch.reserve(writes.size());
+  for (const diskWrite& w : writes) {
+    if (w.offset + w.size > this->diskSize) {
+      done(-1);
+      return;
+    }
+    batch.push_back({this->fd, w.offset, const_cast<void*>(w.buffer), w.size, true, false});
+  }
+  this->engine->submit(batch, std::move(done));
+}
+
+int FileDisk::sync() {
+  return ::fdatasync(this->fd) == 0 ? 0 : -1;
+}
+
+void FileDisk::syncAsync(std::function<void(int)> done) {
+  this->engine->submit({{this->fd, 0, nullptr, 0, false, true}}, std::move(done));
+}
+
+int FileDisk::discard(size_t offset, size_t size) {
+  if (offset + size > this->diskSize) {
+    return -1;
+  }
+  return VDisk::fallocateRange(this->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, size);
+}
+
+int FileDisk::provision(size_t offset, size_t size) {
+  if (offset + size > this->diskSize) {
+    return -1;
+  }
+  return VDisk::fallocateRange(this->fd, 0, offset, size);
+}
@@ -0,0 +1,49 @@
+#include "../include/IOEngine.h"
+#include "../include/ThreadPoolEngine.h"
+#include "../include/UringEngine.h"
+#include <condition_variable>
+#include <mutex>
+#include <stdexcept>
+
+IOEngine::~IOEngine() {
+}
+
+int IOEngine::run(const std::vector<ioRequest>& batch) {
+  std::mutex m;
+  std::condition_variable cv;
+  bool terminado = false;
+  int result = 0;
+  this->submit(batch, [&](int r) {
+    std::lock_guard<std::mutex> guard(m);
+    result = r;
+    terminado = true;
+    cv.notify_one();
+  });
+
+  std::unique_lock<std::mutex> guard(m);
+  cv.wait(guard, [&] { return terminado; });
+  return result;
+}
+
+IOEngine* IOEngine::create() {
+  //  io_uring puede faltar por la version del kernel o estar bloqueado (seccomp, contenedores)
+  try {
+    return new UringEngine(IO_QUEUE_DEPTH);
+  } catch (const std::runtime_error&) {
+    return new ThreadPoolEngine(IO_POOL_THREADS);
+  }
+}
+
+IOEngine::batchState* IOEngine::startBatch(size_t operations, std::function<void(int)> done) {
+  return new batchState{{operations}, {false}, std::move(done)};
+}
+
+void IOEngine::complete(batchState* state, bool ok) {
+  if (!ok) {
+    state->failed = true;
+  }
+  if (--state->pending == 0) {
+    state->done(state->failed ? -1 : 0);
+    delete state;
+  }
+}
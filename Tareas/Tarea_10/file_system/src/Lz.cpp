@@ -0,0 +1,167 @@
+#include "../include/Lz.h"
+#include <cstdint>
+#include <cstring>
+
+#define LZ_MIN_MATCH 4  //  copia mas corta que vale la pena
+#define LZ_HASH_BITS 12  //  entradas de la tabla hash: 1 << LZ_HASH_BITS
+#define LZ_MAX_DISTANCE 65535  //  la distancia se guarda en 16 bits
+#define LZ_LAST_LITERALS 5  //  los ultimos bytes siempre van como literales
+#define LZ_MATCH_LIMIT 12  //  ninguna copia empieza en los ultimos bytes
+
+static uint32_t read32(const uint8_t* p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static uint32_t hash(uint32_t v) {
+  return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+//  un largo de 15 o mas sigue en bytes de 255 y un resto
+static uint8_t* writeLength(uint8_t* out, size_t length) {
+  for (length -= 15; length >= 255; length -= 255) {
+    *out++ = 255;
+  }
+  *out++ = (uint8_t)length;
+  return out;
+}
+
+//  una secuencia: token, literales y, salvo en la ultima, la copia
+static uint8_t* writeSequence(uint8_t* out, uint8_t* outEnd, const uint8_t* literals, size_t literalLength,
+                              size_t distance, size_t matchLength) {
+  size_t needed = 1 + literalLength + literalLength / 255 + 1 + (matchLength ? 2 + matchLength / 255 + 1 : 0);
+  if (needed > (size_t)(outEnd - out)) {
+    return nullptr;
+  }
+
+  size_t extra = matchLength ? matchLength - LZ_MIN_MATCH : 0;
+  uint8_t* token = out++;
+  *token = (uint8_t)((literalLength < 15 ? literalLength : 15) << 4);
+  if (literalLength >= 15) {
+    out = writeLength(out, literalLength);
+  }
+  memcpy(out, literals, literalLength);
+  out += literalLength;
+  if (matchLength == 0) {
+    return out;
+  }
+
+  *out++ = (uint8_t)(distance & 0xFF);
+  *out++ = (uint8_t)(distance >> 8);
+  *token |= (uint8_t)(extra < 15 ? extra : 15);
+  if (extra >= 15) {
+    out = writeLength(out, extra);
+  }
+  return out;
+}
+
+long Lz::compress(const char* source, size_t size, char* dest, size_t capacity) {
+  const uint8_t* in = reinterpret_cast<const uint8_t*>(source);
+  const uint8_t* end = in + size;
+  uint8_t* out = reinterpret_cast<uint8_t*>(dest);
+  uint8_t* outEnd = out + capacity;
+
+  //  posicion + 1 de la ultima vez que se vio cada hash, 0 si nunca
+  uint32_t table[1 << LZ_HASH_BITS] = {0};
+  const uint8_t* anchor = in;
+  const uint8_t* ip = in;
+  while (size > LZ_MATCH_LIMIT && ip + LZ_MATCH_LIMIT < end) {
+    uint32_t v = read32(ip);
+    uint32_t& slot = table[hash(v)];
+    const uint8_t* match = slot ? in + slot - 1 : nullptr;
+    slot = (uint32_t)(ip - in) + 1;
+    if (match == nullptr || ip - match > LZ_MAX_DISTANCE || read32(match) != v) {
+      ip++;
+      continue;
+    }
+
+    //  la copia se estira hacia atras sobre los literales y hacia adelante
+    while (ip > anchor && match > in && ip[-1] == match[-1]) {
+      ip--;
+      match--;
+    }
+    const uint8_t* limit = end - LZ_LAST_LITERALS;
+    size_t length = LZ_MIN_MATCH;
+    while (ip + length < limit && ip[length] == match[length]) {
+      length++;
+    }
+
+    out = writeSequence(out, outEnd, anchor, ip - anchor, ip - match, length);
+    if (out == nullptr) {
+      return -1;
+    }
+    ip += length;
+    anchor = ip;
+  }
+
+  out = writeSequence(out, outEnd, anchor, end - anchor, 0, 0);
+  if (out == nullptr) {
+    return -1;
+  }
+  return out - reinterpret_cast<uint8_t*>(dest);
+}
+
+//  leer un largo extendido; false si los datos se terminan antes
+static bool readLength(const uint8_t*& in, const uint8_t* end, size_t& length) {
+  uint8_t b;
+  do {
+    if (in == end) {
+      return false;
+    }
+    b = *in++;
+    length += b;
+  } while (b == 255);
+  return true;
+}
+
+long Lz::decompress(const char* source, size_t size, char* dest, size_t capacity) {
+  const uint8_t* in = reinterpret_cast<const uint8_t*>(source);
+  const uint8_t* end = in + size;
+  uint8_t* start = reinterpret_cast<uint8_t*>(dest);
+  uint8_t* out = start;
+  uint8_t* outEnd = start + capacity;
+
+  while (in < end) {
+    uint8_t token = *in++;
+    size_t literalLength = token >> 4;
+    if (literalLength == 15 && !readLength(in, end, literalLength)) {
+      return -1;
+    }
+    if (literalLength > (size_t)(end - in) || literalLength > (size_t)(outEnd - out)) {
+      return -1;
+    }
+    memcpy(out, in, literalLength);
+    in += literalLength;
+    out += literalLength;
+    if (in == end) {
+      break;  //  la ultima secuencia no tiene copia
+    }
+
+    if (end - in < 2) {
+      return -1;
+    }
+    size_t distance = in[0] | (in[1] << 8);
+    in += 2;
+    size_t matchLength = token & 15;
+    if (matchLength == 15 && !readLength(in, end, matchLength)) {
+      return -1;
+    }
+    matchLength += LZ_MIN_MATCH;
+    if (distance == 0 || distance > (size_t)(out - start) || matchLength > (size_t)(outEnd - out)) {
+      return -1;
+    }
+
+    //  una copia mas larga que su distancia repite lo que va escribiendo
+    const uint8_t* from = out - distance;
+    if (distance >= matchLength) {
+      memcpy(out, from, matchLength);
+      out += matchLength;
+    } else {
+      for (size_t i = 0; i < matchLength; i++) {
+        *out++ = from[i];
+      }
+    }
+  }
+  return out - start;
+}
@@ -0,0 +1,86 @@
+#include "../include/MemoryDisk.h"
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/mman.h>
+
+MemoryDisk::MemoryDisk(size_t size) {
+  this->mapped = (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+
+  //  MAP_HUGETLB solo funciona si el host reservo paginas grandes
+  //  (vm.nr_hugepages); si no, paginas comunes y transparent huge pages
+  void* map = ::mmap(nullptr, this->mapped, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (map != MAP_FAILED) {
+    this->huge = true;
+    this->pageSize = HUGE_PAGE_SIZE;
+  } else {
+    map = ::mmap(nullptr, this->mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED) {
+      throw std::runtime_error("MemoryDisk: mmap failed: " + std::string(std::strerror(errno)));
+    }
+    ::madvise(map, this->mapped, MADV_HUGEPAGE);
+    this->pageSize = ::sysconf(_SC_PAGESIZE);
+  }
+
+  this->base = static_cast<char*>(map);
+  this->diskSize = size;
+}
+
+MemoryDisk::~MemoryDisk() {
+  ::munmap(this->base, this->mapped);
+}
+
+int MemoryDisk::read(size_t offset, void* buffer, size_t size) {
+  if (offset + size > this->diskSize) {
+    return -1;
+  }
+  memcpy(buffer, this->base + offset, size);
+  return 0;
+}
+
+int MemoryDisk::write(size_t offset, const void* buffer, size_t size) {
+  if (offset + size > this->diskSize) {
+    return -1;
+  }
+  memcpy(this->base + offset, buffer, size);
+  return 0;
+}
+
+int MemoryDisk::sync() {
+  return 0;
+}
+
+int MemoryDisk::discard(size_t offset, size_t size) {
+  if (offset + size > this->diskSize) {
+    return -1;
+  }
+
+  //  solo las paginas que el rango cubre enteras; lo de los bordes queda como
+  //  estaba, igual que con un archivo que no soporta el modo
+  size_t begin = (offset + this->pageSize - 1) / this->pageSize * this->pageSize;
+  size_t end = (offset + size) / this->pageSize * this->pageSize;
+  if (begin < end) {
+    ::madvise(this->base + begin, end - begin, MADV_DONTNEED);
+  }
+  return 0;
+}
+
+int MemoryDisk::provision(size_t offset, size_t size) {
+  if (offset + size > this->diskSize) {
+    return -1;
+  }
+#ifdef MADV_POPULATE_WRITE
+  //  un kernel anterior a 5.14 no lo conoce y las paginas se asignan al usarlas
+  size_t begin = offset / this->pageSize * this->pageSize;
+  if (size > 0) {
+    ::madvise(this->base + begin, offset + size - begin, MADV_POPULATE_WRITE);
+  }
+#endif
+  return 0;
+}
+
+bool MemoryDisk::hugePages() const {
+  return this->huge;
+}
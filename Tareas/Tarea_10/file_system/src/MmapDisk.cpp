@@ -0,0 +1,105 @@
+#include "../include/MmapDisk.h"
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+MmapDisk::MmapDisk(const std::string& path, size_t size) {
+  this->fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+  if (this->fd == -1) {
+    throw std::runtime_error("MmapDisk: could not open " + path + ": " + std::strerror(errno));
+  }
+
+  //  asegurar que el archivo tenga el tamano correcto antes de mapearlo
+  struct stat st;
+  if (::fstat(this->fd, &st) == -1 || (size_t)st.st_size < size) {
+    if (::ftruncate(this->fd, size) == -1) {
+      ::close(this->fd);
+      throw std::runtime_error("MmapDisk: ftruncate failed: " + std::string(std::strerror(errno)));
+    }
+  }
+
+  void* map = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, this->fd, 0);
+  if (map == MAP_FAILED) {
+    ::close(this->fd);
+    throw std::runtime_error("MmapDisk: mmap failed: " + std::string(std::strerror(errno)));
+  }
+
+  this->base = static_cast<char*>(map);
+  this->diskSize = size;
+  this->dirtyBegin = size;
+  this->dirtyEnd = 0;
+}
+
+MmapDisk::~MmapDisk() {
+  this->sync();
+  ::munmap(this->base, this->diskSize);
+  ::close(this->fd);
+}
+
+int MmapDisk::read(size_t offset, void* buffer, size_t size) {
+  if (offset + size > this->diskSize) {
+    return -1;
+  }
+  memcpy(buffer, this->base + offset, size);
+  return 0;
+}
+
+int MmapDisk::write(size_t offset, const void* buffer, size_t size) {
+  if (offset + size > this->diskSize) {
+    return -1;
+  }
+  memcpy(this->base + offset, buffer, size);
+  std::lock_guard<std::mutex> guard(this->dirtyLock);
+  this->dirtyBegin = std::min(this->dirtyBegin, offset);
+  this->dirtyEnd = std::max(this->dirtyEnd, offset + size);
+  return 0;
+}
+
+int MmapDisk::sync() {
+  //  el rango se toma y se vacia de una vez; lo que se escriba durante el
+  //  msync queda para el siguiente sync
+  size_t dirtyBegin;
+  size_t dirtyEnd;
+  {
+    std::lock_guard<std::mutex> guard(this->dirtyLock);
+    dirtyBegin = this->dirtyBegin;
+    dirtyEnd = this->dirtyEnd;
+    this->dirtyBegin = this->diskSize;
+    this->dirtyEnd = 0;
+  }
+  if (dirtyBegin >= dirtyEnd) {
+    return 0;
+  }
+
+  //  msync exige una direccion alineada a pagina
+  size_t page = ::sysconf(_SC_PAGESIZE);
+  size_t begin = dirtyBegin & ~(page - 1);
+  if (::msync(this->base + begin, dirtyEnd - begin, MS_SYNC) == 0) {
+    return 0;
+  }
+
+  //  si fallo, el rango sigue sucio
+  std::lock_guard<std::mutex> guard(this->dirtyLock);
+  this->dirtyBegin = std::min(this->dirtyBegin, dirtyBegin);
+  this->dirtyEnd = std::max(this->dirtyEnd, dirtyEnd);
+  return -1;
+}
+
+int MmapDisk::discard(size_t offset, size_t size) {
+  if (offset + size > this->diskSize) {
+    return -1;
+  }
+  return VDisk::fallocateRange(this->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, size);
+}
+
+int MmapDisk::provision(size_t offset, size_t size) {
+  if (offset + size > this->diskSize) {
+    return -1;
+  }
+  return VDisk::fallocateRange(this->fd, 0, offset, size);
+}
@@ -0,0 +1,67 @@
+#include "../include/Murmur3.h"
+#include <algorithm>
+#include <cstring>
+
+static const uint64_t C1 = 0x87c37b91114253d5ULL;
+static const uint64_t C2 = 0x4cf5ad432745937fULL;
+
+static uint64_t rotl(uint64_t x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+//  mezcla final: cada bit de entrada afecta a todos los de salida
+static uint64_t fmix(uint64_t k) {
+  k ^= k >> 33;
+  k *= 0xff51afd7ed558ccdULL;
+  k ^= k >> 33;
+  k *= 0xc4ceb9fe1a85ec53ULL;
+  k ^= k >> 33;
+  return k;
+}
+
+hash128 Murmur3::compute(const void* data, size_t size, uint32_t seed) {
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  uint64_t h1 = seed;
+  uint64_t h2 = seed;
+
+  size_t blocks = size / 16;
+  for (size_t i = 0; i < blocks; i++) {
+    uint64_t k1;
+    uint64_t k2;
+    memcpy(&k1, bytes + i * 16, sizeof(k1));
+    memcpy(&k2, bytes + i * 16 + 8, sizeof(k2));
+
+    h1 ^= rotl(k1 * C1, 31) * C2;
+    h1 = (rotl(h1, 27) + h2) * 5 + 0x52dce729;
+    h2 ^= rotl(k2 * C2, 33) * C1;
+    h2 = (rotl(h2, 31) + h1) * 5 + 0x38495ab5;
+  }
+
+  //  los ultimos size % 16 bytes, en little endian como el resto
+  const unsigned char* tail = bytes + blocks * 16;
+  size_t rest = size % 16;
+  uint64_t k1 = 0;
+  uint64_t k2 = 0;
+  for (size_t i = rest; i > 8; i--) {
+    k2 ^= (uint64_t)tail[i - 1] << ((i - 9) * 8);
+  }
+  for (size_t i = std::min(rest, (size_t)8); i > 0; i--) {
+    k1 ^= (uint64_t)tail[i - 1] << ((i - 1) * 8);
+  }
+  if (rest > 8) {
+    h2 ^= rotl(k2 * C2, 33) * C1;
+  }
+  if (rest > 0) {
+    h1 ^= rotl(k1 * C1, 31) * C2;
+  }
+
+  h1 ^= size;
+  h2 ^= size;
+  h1 += h2;
+  h2 += h1;
+  h1 = fmix(h1);
+  h2 = fmix(h2);
+  h1 += h2;
+  h2 += h1;
+  return hash128{h1, h2};
+}
@@ -0,0 +1,102 @@
+#include "../include/NameIndex.h"
+#include <cstring>
+
+NameIndex::NameIndex(KeyFunction keyOf, const void* owner)
+    : keyOf(keyOf), owner(owner) {
+  this->clear();
+}
+
+void NameIndex::clear() {
+  this->slots.assign(16, slot{0, EMPTY});
+  this->used = 0;
+  this->deleted = 0;
+}
+
+//  FNV-1a de 32 bits
+uint32_t NameIndex::hash(std::string_view name) {
+  uint32_t h = 2166136261u;
+  for (unsigned char c : name) {
+    h ^= c;
+    h *= 16777619u;
+  }
+  return h;
+}
+
+long NameIndex::findSlot(std::string_view name, uint32_t h) const {
+  size_t mask = this->slots.size() - 1;
+  for (size_t i = h & mask; ; i = (i + 1) & mask) {
+    const slot& s = this->slots[i];
+    if (s.value == EMPTY) {
+      return -1;
+    }
+    if (s.value != DELETED && s.hash == h) {
+      const char* key = this->keyOf(this->owner, s.value);
+      if (strlen(key) == name.size() && memcmp(key, name.data(), name.size()) == 0) {
+        return i;
+      }
+    }
+  }
+}
+
+int NameIndex::find(std::string_view name) const {
+  long i = this->findSlot(name, hash(name));
+  return i == -1 ? -1 : this->slots[i].value;
+}
+
+void NameIndex::insert(std::string_view name, int value) {
+  //  mantener la carga (incluyendo borrados) por debajo de 3/4
+  if ((this->used + this->deleted + 1) * 4 > this->slots.size() * 3) {
+    size_t capacity = this->slots.size();
+    if ((this->used + 1) * 2 > capacity) {
+      capacity *= 2;
+    }
+    this->rehash(capacity);
+  }
+
+  uint32_t h = hash(name);
+  size_t mask = this->slots.size() - 1;
+  size_t i = h & mask;
+  while (this->slots[i].value >= 0) {
+    i = (i + 1) & mask;
+  }
+  if (this->slots[i].value == DELETED) {
+    this->deleted--;
+  }
+  this->slots[i] = slot{h, value};
+  this->used++;
+}
+
+int NameIndex::erase(std::string_view name) {
+  long i = this->findSlot(name, hash(name));
+  if (i == -1) {
+    return -1;
+  }
+  int value = this->slots[i].value;
+  this->slots[i].value = DELETED;
+  this->used--;
+  this->deleted++;
+  return value;
+}
+
+size_t NameIndex::size() const {
+  return this->used;
+}
+
+void NameIndex::rehash(size_t capacity) {
+  std::vector<slot> old;
+  old.swap(this->slots);
+  this->slots.assign(capacity, slot{0, EMPTY});
+  this->deleted = 0;
+
+  //  el hash ya esta guardado, no hace falta volver a leer los nombres
+  size_t mask = capacity - 1;
+  for (const slot& s : old) {
+    if (s.value >= 0) {
+      size_t i = s.hash & mask;
+      while (this->slots[i].value != EMPTY) {
+        i = (i + 1) & mask;
+      }
+      this->slots[i] = s;
+    }
+  }
+}
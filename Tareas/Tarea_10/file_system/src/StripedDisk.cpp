@@ -0,0 +1,198 @@
+#include "../include/StripedDisk.h"
+#include <stdexcept>
+#include <algorithm>
+#include <atomic>
+#include <future>
+#include <memory>
+
+StripedDisk::StripedDisk(const std::vector<VDisk*>& disks, size_t stripeBytes)
+    : disks(disks), stripeBytes(stripeBytes) {
+  if (disks.empty() || stripeBytes == 0) {
+    throw std::runtime_error("StripedDisk: se necesita al menos un disco y franjas de mas de 0 bytes");
+  }
+
+  //  todas las imagenes aportan las mismas franjas, las de la mas chica
+  size_t stripes = disks[0]->size() / stripeBytes;
+  for (VDisk* disk : disks) {
+    stripes = std::min(stripes, disk->size() / stripeBytes);
+  }
+  this->diskSize = stripes * stripeBytes * disks.size();
+}
+
+StripedDisk::~StripedDisk() {
+  for (VDisk* disk : this->disks) {
+    delete disk;
+  }
+}
+
+void StripedDisk::split(size_t offset, size_t size,
+                        const std::function<void(size_t disk, size_t diskOffset, size_t position, size_t length)>& piece) {
+  size_t position = 0;
+  while (position < size) {
+    size_t stripe = (offset + position) / this->stripeBytes;
+    size_t within = (offset + position) % this->stripeBytes;
+    size_t length = std::min(this->stripeBytes - within, size - position);
+    piece(stripe % this->disks.size(), (stripe / this->disks.size()) * this->stripeBytes + within, position, length);
+    position += length;
+  }
+}
+
+void StripedDisk::onEachDisk(const std::vector<bool>& busy,
+                             const std::function<void(size_t disk, std::function<void(int)> done)>& start,
+                             std::function<void(int)> done) {
+  //  cuenta de los discos que faltan; el que termina ultimo avisa
+  struct pending {
+    std::atomic<int> disks;
+    std::atomic<int> result;
+    std::function<void(int)> done;
+  };
+  int count = std::count(busy.begin(), busy.end(), true);
+  if (count == 0) {
+    done(0);
+    return;
+  }
+  std::shared_ptr<pending> state = std::make_shared<pending>();
+  state->disks = count;
+  state->result = 0;
+  state->done = std::move(done);
+  for (size_t d = 0; d < busy.size(); d++) {
+    if (!busy[d]) {
+      continue;
+    }
+    start(d, [state](int result) {
+      if (result == -1) {
+        state->result = -1;
+      }
+      if (--state->disks == 0) {
+        state->done(state->result);
+      }
+    });
+  }
+}
+
+int StripedDisk::wait(const std::function<void(std::function<void(int)> done)>& start) {
+  //  done puede llegar desde otro hilo: la promesa vive hasta que termina de usarla
+  std::shared_ptr<std::promise<int>> result = std::make_shared<std::promise<int>>();
+  std::future<int> hecho = result->get_future();
+  start([result](int r) {
+    result->set_value(r);
+  });
+  return hecho.get();
+}
+
+int StripedDisk::read(size_t offset, void* buffer, size_t size) {
+  std::vector<diskRead> reads(1, diskRead{offset, buffer, size});
+  return this->readBatch(reads);
+}
+
+int StripedDisk::write(size_t offset, const void* buffer, size_t size) {
+  std::vector<diskWrite> writes(1, diskWrite{offset, buffer, size});
+  return this->writeBatch(writes);
+}
+
+//  los lotes sincronicos son los asincronos esperados: cada disco los hace con
+//  su propio IOEngine y ningun hilo se crea por lote
+int StripedDisk::readBatch(std::vector<diskRead>& reads) {
+  return wait([&](std::function<void(int)> done) {
+    this->readAsync(reads, std::move(done));
+  });
+}
+
+int StripedDisk::writeBatch(std::vector<diskWrite>& writes) {
+  return wait([&](std::function<void(int)> done) {
+    this->writeAsync(writes, std::move(done));
+  });
+}
+
+void StripedDisk::readAsync(std::vector<diskRead> reads, std::function<void(int)> done) {
+  std::vector<std::vector<diskRead>> porDisco(this->disks.size());
+  for (const diskRead& r : reads) {
+    if (r.offset + r.size > this->diskSize) {
+      done(-1);
+      return;
+    }
+    char* buffer = static_cast<char*>(r.buffer);
+    this->split(r.offset, r.size, [&](size_t disk, size_t diskOffset, size_t position, size_t length) {
+      porDisco[disk].push_back({diskOffset, buffer + position, length});
+    });
+  }
+
+  std::vector<bool> busy(this->disks.size());
+  for (size_t d = 0; d < busy.size(); d++) {
+    busy[d] = !porDisco[d].empty();
+  }
+  this->onEachDisk(busy, [&](size_t d, std::function<void(int)> parte) {
+    this->disks[d]->readAsync(std::move(porDisco[d]), std::move(parte));
+  }, std::move(done));
+}
+
+void StripedDisk::writeAsync(std::vector<diskWrite> writes, std::function<void(int)> done) {
+  std::vector<std::vector<diskWrite>> porDisco(this->disks.size());
+  for (const diskWrite& w : writes) {
+    if (w.offset + w.size > this->diskSize) {
+      done(-1);
+      return;
+    }
+    const char* buffer = static_cast<const char*>(w.buffer);
+    this->split(w.offset, w.size, [&](size_t disk, size_t diskOffset, size_t position, size_t length) {
+      porDisco[disk].push_back({diskOffset, buffer + position, length});
+    });
+  }
+
+  std::vector<bool> busy(this->disks.size());
+  for (size_t d = 0; d < busy.size(); d++) {
+    busy[d] = !porDisco[d].empty();
+  }
+  this->onEachDisk(busy, [&](size_t d, std::function<void(int)> parte) {
+    this->disks[d]->writeAsync(std::move(porDisco[d]), std::move(parte));
+  }, std::move(done));
+}
+
+int StripedDisk::sync() {
+  return wait([&](std::function<void(int)> done) {
+    this->syncAsync(std::move(done));
+  });
+}
+
+void StripedDisk::syncAsync(std::function<void(int)> done) {
+  std::vector<bool> busy(this->disks.size(), true);
+  this->onEachDisk(busy, [&](size_t d, std::function<void(int)> parte) {
+    this->disks[d]->syncAsync(std::move(parte));
+  }, std::move(done));
+}
+
+int StripedDisk::discard(size_t offset, size_t size) {
+  return this->eachRange(offset, size, [](VDisk* disk, size_t diskOffset, size_t length) {
+    return disk->discard(diskOffset, length);
+  });
+}
+
+int StripedDisk::provision(size_t offset, size_t size) {
+  return this->eachRange(offset, size, [](VDisk* disk, size_t diskOffset, size_t length) {
+    return disk->provision(diskOffset, length);
+  });
+}
+
+int StripedDisk::eachRange(size_t offset, size_t size, const std::function<int(VDisk* disk, size_t diskOffset, size_t length)>& apply) {
+  if (offset + size > this->diskSize) {
+    return -1;
+  }
+
+  //  dentro de un rango las franjas s y s + N quedan seguidas en su disco, asi
+  //  que a cada disco le toca un solo tramo y no uno por franja
+  std::vector<std::pair<size_t, size_t>> tramos(this->disks.size(), {0, 0});
+  this->split(offset, size, [&](size_t disk, size_t diskOffset, size_t, size_t length) {
+    if (tramos[disk].second == 0) {
+      tramos[disk].first = diskOffset;
+    }
+    tramos[disk].second += length;
+  });
+
+  int result = 0;
+  for (size_t d = 0; d < this->disks.size(); d++) {
+    if (tramos[d].second > 0 && apply(this->disks[d], tramos[d].first, tramos[d].second) == -1) {
+      result = -1;
+    }
+  }
+  return result;
+}
@@ -0,0 +1,87 @@
+#include "../include/ThreadPoolEngine.h"
+#include <cerrno>
+#include <unistd.h>
+
+ThreadPoolEngine::ThreadPoolEngine(unsigned threads) {
+  for (unsigned i = 0; i < threads; i++) {
+    this->workers.emplace_back(&ThreadPoolEngine::work, this);
+  }
+}
+
+ThreadPoolEngine::~ThreadPoolEngine() {
+  //  los hilos terminan lo que queda en la cola antes de salir
+  {
+    std::lock_guard<std::mutex> guard(this->lock);
+    this->stopping = true;
+  }
+  this->ready.notify_all();
+  for (std::thread& worker : this->workers) {
+    worker.join();
+  }
+}
+
+void ThreadPoolEngine::submit(const std::vector<ioRequest>& batch, std::function<void(int)> done) {
+  if (batch.empty()) {
+    done(0);
+    return;
+  }
+  batchState* state = startBatch(batch.size(), std::move(done));
+  {
+    std::lock_guard<std::mutex> guard(this->lock);
+    for (const ioRequest& request : batch) {
+      this->queue.push_back(task{request, state, nullptr});
+    }
+  }
+  this->ready.notify_all();
+}
+
+void ThreadPoolEngine::post(std::function<void()> job) {
+  {
+    std::lock_guard<std::mutex> guard(this->lock);
+    this->queue.push_back(task{ioRequest{}, nullptr, std::move(job)});
+  }
+  this->ready.notify_one();
+}
+
+void ThreadPoolEngine::work() {
+  std::unique_lock<std::mutex> guard(this->lock);
+  while (true) {
+    this->ready.wait(guard, [this] { return this->stopping || !this->queue.empty(); });
+    if (this->queue.empty()) {
+      return;
+    }
+    task next = this->queue.front();
+    this->queue.pop_front();
+
+    guard.unlock();
+    if (next.job) {
+      next.job();
+    } else {
+      complete(next.state, transfer(next.request));
+    }
+    guard.lock();
+  }
+}
+
+bool ThreadPoolEngine::transfer(const ioRequest& request) {
+  if (request.sync) {
+    return ::fdatasync(request.fd) == 0;
+  }
+  char* buffer = static_cast<char*>(request.buffer);
+  size_t offset = request.offset;
+  size_t size = request.size;
+  while (size > 0) {
+    ssize_t hecho = request.write ? ::pwrite(request.fd, buffer, size, offset)
+                                  : ::pread(request.fd, buffer, size, offset);
+    if (hecho <= 0) {
+      if (hecho == -1 && errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    buffer += hecho;
+    offset += hecho;
+    size -= hecho;
+  }
+  return true;
+}
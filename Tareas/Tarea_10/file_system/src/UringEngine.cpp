@@ -0,0 +1,301 @@
+#include "../include/UringEngine.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+//  una operacion mas larga que esto se completa en varias vueltas por el anillo
+static const size_t MAX_OPERATION = 1u << 30;
+
+//  el kernel lee sqTail y escribe cqTail desde otro contexto: los indices
+//  compartidos se leen con acquire y se publican con release
+static unsigned loadAcquire(const unsigned* index) {
+  return __atomic_load_n(index, __ATOMIC_ACQUIRE);
+}
+
+static void storeRelease(unsigned* index, unsigned value) {
+  __atomic_store_n(index, value, __ATOMIC_RELEASE);
+}
+
+static int uringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+  return syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0);
+}
+
+//  si el kernel del anillo fd sabe hacer todas las operaciones que push usa;
+//  IORING_REGISTER_PROBE llego con IORING_OP_READ y IORING_OP_WRITE, asi que
+//  un kernel sin probe tampoco las tiene
+static bool supportsOperations(int fd) {
+  const unsigned char needed[] = {IORING_OP_NOP, IORING_OP_READ, IORING_OP_WRITE, IORING_OP_FSYNC};
+  const unsigned slots = 256;
+  std::vector<char> memory(sizeof(io_uring_probe) + slots * sizeof(io_uring_probe_op), 0);
+  io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(memory.data());
+  if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, slots) < 0) {
+    return false;
+  }
+  for (unsigned char opcode : needed) {
+    if (opcode > probe->last_op || opcode >= probe->ops_len || !(probe->ops[opcode].flags & IO_URING_OP_SUPPORTED)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+UringEngine::UringEngine(unsigned depth) {
+  io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  this->ringFd = syscall(__NR_io_uring_setup, depth, &params);
+  if (this->ringFd < 0) {
+    throw std::runtime_error("UringEngine: io_uring_setup failed: " + std::string(std::strerror(errno)));
+  }
+  if (!supportsOperations(this->ringFd)) {
+    ::close(this->ringFd);
+    throw std::runtime_error("UringEngine: the kernel lacks IORING_OP_READ, WRITE or FSYNC");
+  }
+
+  //  con IORING_FEAT_SINGLE_MMAP los dos anillos comparten un solo mapeo
+  this->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  this->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single) {
+    this->sqRingSize = this->cqRingSize = std::max(this->sqRingSize, this->cqRingSize);
+  }
+  this->sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+
+  void* sq = ::mmap(nullptr, this->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+      this->ringFd, IORING_OFF_SQ_RING);
+  this->sqRing = sq == MAP_FAILED ? nullptr : sq;
+  void* cq = single ? sq : ::mmap(nullptr, this->cqRingSize, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE, this->ringFd, IORING_OFF_CQ_RING);
+  this->cqRing = cq == MAP_FAILED ? nullptr : cq;
+  void* entries = ::mmap(nullptr, this->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+      this->ringFd, IORING_OFF_SQES);
+  this->sqes = entries == MAP_FAILED ? nullptr : static_cast<io_uring_sqe*>(entries);
+  if (this->sqRing == nullptr || this->cqRing == nullptr || this->sqes == nullptr) {
+    this->unmap();
+    throw std::runtime_error("UringEngine: mmap of the rings failed");
+  }
+
+  char* sqBase = static_cast<char*>(this->sqRing);
+  this->sqTail = reinterpret_cast<unsigned*>(sqBase + params.sq_off.tail);
+  this->sqMask = *reinterpret_cast<unsigned*>(sqBase + params.sq_off.ring_mask);
+  this->sqArray = reinterpret_cast<unsigned*>(sqBase + params.sq_off.array);
+  this->sqEntries = params.sq_entries;
+
+  char* cqBase = static_cast<char*>(this->cqRing);
+  this->cqHead = reinterpret_cast<unsigned*>(cqBase + params.cq_off.head);
+  this->cqTail = reinterpret_cast<unsigned*>(cqBase + params.cq_off.tail);
+  this->cqMask = *reinterpret_cast<unsigned*>(cqBase + params.cq_off.ring_mask);
+  this->cqes = reinterpret_cast<io_uring_cqe*>(cqBase + params.cq_off.cqes);
+
+  this->reaper = std::thread(&UringEngine::reap, this);
+}
+
+UringEngine::~UringEngine() {
+  std::vector<operation*> rejected;
+  {
+    std::unique_lock<std::mutex> guard(this->lock);
+    this->space.wait(guard, [this] { return this->inFlight == 0; });
+    //  un NOP sin operacion despierta al hilo de terminaciones y le indica
+    //  que salga; con el anillo roto ya salio solo
+    if (!this->broken) {
+      this->push(nullptr);
+    }
+    if (!this->broken && this->flush(1, rejected) == -1) {
+      //  el hilo sigue esperando en el anillo: no se puede desmapear debajo suyo
+      this->reaper.detach();
+      return;
+    }
+  }
+  this->reaper.join();
+  this->unmap();
+}
+
+void UringEngine::unmap() {
+  if (this->sqes != nullptr) {
+    ::munmap(this->sqes, this->sqesSize);
+  }
+  if (this->cqRing != nullptr && this->cqRing != this->sqRing) {
+    ::munmap(this->cqRing, this->cqRingSize);
+  }
+  if (this->sqRing != nullptr) {
+    ::munmap(this->sqRing, this->sqRingSize);
+  }
+  ::close(this->ringFd);
+}
+
+void UringEngine::submit(const std::vector<ioRequest>& batch, std::function<void(int)> done) {
+  if (batch.empty()) {
+    done(0);
+    return;
+  }
+
+  batchState* state = startBatch(batch.size(), std::move(done));
+  std::vector<operation*> rejected;
+  {
+    std::unique_lock<std::mutex> guard(this->lock);
+    size_t i = 0;
+    while (i < batch.size()) {
+      //  con el anillo lleno se espera a que terminen operaciones anteriores
+      this->space.wait(guard, [this] { return this->broken || this->inFlight < this->sqEntries; });
+      //  con el anillo roto el lote falla sin entrar
+      if (this->broken) {
+        while (i < batch.size()) {
+          rejected.push_back(new operation{batch[i++], state});
+        }
+        break;
+      }
+      unsigned count = 0;
+      while (i < batch.size() && this->inFlight < this->sqEntries) {
+        operation* op = new operation{batch[i++], state};
+        this->active.insert(op);
+        this->push(op);
+        this->inFlight++;
+        count++;
+      }
+      this->flush(count, rejected);
+    }
+  }
+
+  for (operation* op : rejected) {
+    complete(op->state, false);
+    delete op;
+  }
+}
+
+void UringEngine::push(operation* op) {
+  //  solo este lado escribe sqTail, el kernel avanza sqHead al consumir
+  unsigned tail = *this->sqTail;
+  unsigned index = tail & this->sqMask;
+  io_uring_sqe* sqe = &this->sqes[index];
+  memset(sqe, 0, sizeof(io_uring_sqe));
+  if (op == nullptr) {
+    sqe->opcode = IORING_OP_NOP;
+  } else if (op->request.sync) {
+    sqe->opcode = IORING_OP_FSYNC;
+    sqe->fd = op->request.fd;
+    sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+  } else {
+    sqe->opcode = op->request.write ? IORING_OP_WRITE : IORING_OP_READ;
+    sqe->fd = op->request.fd;
+    sqe->off = op->request.offset;
+    sqe->addr = reinterpret_cast<uint64_t>(op->request.buffer);
+    sqe->len = std::min(op->request.size, MAX_OPERATION);
+  }
+  sqe->user_data = reinterpret_cast<uint64_t>(op);
+  this->sqArray[index] = index;
+  storeRelease(this->sqTail, tail + 1);
+}
+
+int UringEngine::flush(unsigned count, std::vector<operation*>& rejected) {
+  while (count > 0) {
+    int entregadas = uringEnter(this->ringFd, count, 0, 0);
+    if (entregadas > 0) {
+      count -= entregadas;
+      continue;
+    }
+    if (entregadas == -1 && (errno == EINTR || errno == EAGAIN || errno == EBUSY)) {
+      continue;
+    }
+
+    //  el kernel no tomo las ultimas count: salen de la cola y fallan
+    unsigned tail = *this->sqTail;
+    for (unsigned t = tail - count; t != tail; t++) {
+      operation* op = reinterpret_cast<operation*>(this->sqes[this->sqArray[t & this->sqMask]].user_data);
+      if (op != nullptr) {
+        rejected.push_back(op);
+        this->active.erase(op);
+        this->inFlight--;
+      }
+    }
+    storeRelease(this->sqTail, tail - count);
+    this->space.notify_all();
+    return -1;
+  }
+  return 0;
+}
+
+void UringEngine::reap() {
+  while (true) {
+    unsigned head = *this->cqHead;
+    if (head == loadAcquire(this->cqTail)) {
+      if (uringEnter(this->ringFd, 0, 1, IORING_ENTER_GETEVENTS) == -1) {
+        //  EBUSY es la cola de terminaciones desbordada: la vuelta siguiente
+        //  las recoge. EAGAIN es falta de recursos que pasa sola
+        if (errno == EAGAIN) {
+          std::this_thread::yield();
+        } else if (errno != EINTR && errno != EBUSY) {
+          this->fail();
+          return;
+        }
+      }
+      continue;
+    }
+
+    io_uring_cqe cqe = this->cqes[head & this->cqMask];
+    storeRelease(this->cqHead, head + 1);
+    operation* op = reinterpret_cast<operation*>(cqe.user_data);
+    if (op == nullptr) {
+      return;
+    }
+    this->finish(op, cqe.res);
+  }
+}
+
+void UringEngine::fail() {
+  std::vector<operation*> pending;
+  {
+    std::lock_guard<std::mutex> guard(this->lock);
+    this->broken = true;
+    pending.assign(this->active.begin(), this->active.end());
+    this->active.clear();
+    this->inFlight = 0;
+  }
+  this->space.notify_all();
+  for (operation* op : pending) {
+    complete(op->state, false);
+    delete op;
+  }
+}
+
+void UringEngine::finish(operation* op, int result) {
+  std::vector<operation*> rejected;
+  bool ok;
+  {
+    //  el lock tambien deja ver lo que submit escribio en op, que llego hasta
+    //  aqui pasando por el kernel
+    std::lock_guard<std::mutex> guard(this->lock);
+    ioRequest& request = op->request;
+
+    //  corta o interrumpida: lo que falta vuelve al anillo sin dejar su lugar en inFlight
+    if (result == -EINTR || result == -EAGAIN || (result > 0 && (size_t)result < request.size)) {
+      if (result > 0) {
+        request.buffer = static_cast<char*>(request.buffer) + result;
+        request.offset += result;
+        request.size -= result;
+      }
+      this->push(op);
+      this->flush(1, rejected);
+      op = nullptr;
+    } else {
+      this->active.erase(op);
+      this->inFlight--;
+      ok = result >= 0 && (size_t)result == request.size;
+    }
+  }
+
+  for (operation* failed : rejected) {
+    complete(failed->state, false);
+    delete failed;
+  }
+  if (op != nullptr) {
+    this->space.notify_all();
+    complete(op->state, ok);
+    delete op;
+  }
+}
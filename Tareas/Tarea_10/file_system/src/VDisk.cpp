@@ -0,0 +1,58 @@
+#include "../include/VDisk.h"
+#include <cerrno>
+#include <fcntl.h>
+
+VDisk::~VDisk() {
+}
+
+size_t VDisk::size() const {
+  return this->diskSize;
+}
+
+int VDisk::writeBatch(std::vector<diskWrite>& writes) {
+  for (const diskWrite& w : writes) {
+    if (this->write(w.offset, w.buffer, w.size) == -1) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+int VDisk::readBatch(std::vector<diskRead>& reads) {
+  for (const diskRead& r : reads) {
+    if (this->read(r.offset, r.buffer, r.size) == -1) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+void VDisk::readAsync(std::vector<diskRead> reads, std::function<void(int)> done) {
+  done(this->readBatch(reads));
+}
+
+void VDisk::writeAsync(std::vector<diskWrite> writes, std::function<void(int)> done) {
+  done(this->writeBatch(writes));
+}
+
+void VDisk::syncAsync(std::function<void(int)> done) {
+  done(this->sync());
+}
+
+void VDisk::prefetch(size_t, size_t) {
+}
+
+int VDisk::discard(size_t, size_t) {
+  return 0;
+}
+
+int VDisk::provision(size_t, size_t) {
+  return 0;
+}
+
+int VDisk::fallocateRange(int fd, int mode, size_t offset, size_t size) {
+  if (size == 0 || ::fallocate(fd, mode, offset, size) == 0) {
+    return 0;
+  }
+  return (errno == EOPNOTSUPP || errno == ENOSYS) ? 0 : -1;
+}
@@ -1,5 +1,9 @@
 #include <iostream>
 #include "../include/FS.h"
+#include "../include/FileDisk.h"
+#include "../include/MmapDisk.h"
+#include "../include/MemoryDisk.h"
+#include "../include/StripedDisk.h"
 
 void showMenu() {
     std::cout << "\n=== SISTEMA DE ARCHIVOS ===\n";
@@ -10,12 +14,80 @@ void showMenu() {
     std::cout << "5. Eliminar archivo\n";
     std::cout << "6. Mostrar superbloque\n";
     std::cout << "7. cambiar nombre de archivo\n";
+    std::cout << "8. Revisar checksums del disco\n";
+    std::cout << "9. Agregar contenido comprimido\n";
+    std::cout << "10. Agregar contenido con dedup\n";
+    std::cout << "11. Clonar archivo\n";
+    std::cout << "12. Crear snapshot\n";
+    std::cout << "13. Listar snapshots\n";
+    std::cout << "14. Eliminar snapshot\n";
     std::cout << "0. Salir\n";
     std::cout << "Opción: ";
 }
 
-int main() {
-  FS* fs = new FS();
+int main(int argc, char* argv[]) {
+  //  ./main --mmap monta la imagen con mmap en lugar de pread/pwrite
+  //  ./main --memory trabaja en memoria sin tocar diskFile.bin
+  //  ./main --format empieza con una imagen vacia aunque diskFile.bin tenga datos
+  //  ./main --snapshot nombre monta ese snapshot de solo lectura
+  //  ./main --stripe N reparte el sistema de archivos en diskFile0.bin ...
+  //  diskFile{N-1}.bin, en franjas de --stripe-width bloques (8 por defecto)
+  DiskBackend backend = DiskBackend::File;
+  bool format = false;
+  std::string snapshot;
+  int stripes = 0;
+  int stripeWidth = 8;
+  for (int i = 1; i < argc; i++) {
+    if (std::string(argv[i]) == "--mmap") {
+      backend = DiskBackend::Mmap;
+    } else if (std::string(argv[i]) == "--memory") {
+      backend = DiskBackend::Memory;
+    } else if (std::string(argv[i]) == "--format") {
+      format = true;
+    } else if (std::string(argv[i]) == "--snapshot" && i + 1 < argc) {
+      snapshot = argv[++i];
+    } else if (std::string(argv[i]) == "--stripe" && i + 1 < argc) {
+      stripes = std::max(atoi(argv[++i]), 0);
+    } else if (std::string(argv[i]) == "--stripe-width" && i + 1 < argc) {
+      stripeWidth = std::max(atoi(argv[++i]), 1);
+    }
+  }
+
+  FS* fs;
+  if (stripes > 0) {
+    try {
+      std::vector<VDisk*> images;
+      for (int i = 0; i < stripes; i++) {
+        std::string path = "diskFile" + std::to_string(i) + ".bin";
+        size_t size = (size_t)TOTAL_BLOCKS * BLOCK_SIZE;
+        if (backend == DiskBackend::Mmap) {
+          images.push_back(new MmapDisk(path, size));
+        } else if (backend == DiskBackend::Memory) {
+          images.push_back(new MemoryDisk(size));
+        } else {
+          images.push_back(new FileDisk(path, size));
+        }
+      }
+      fs = new FS(new StripedDisk(images, (size_t)stripeWidth * BLOCK_SIZE), format);
+    } catch (const std::exception& e) {
+      std::cout << "Could not create diskFile: " << e.what() << std::endl;
+      return 1;
+    }
+  } else if (snapshot.empty()) {
+    fs = new FS(backend, format);
+  } else {
+    try {
+      fs = new FS(snapshot, backend);
+    } catch (const std::runtime_error& e) {
+      std::cout << e.what() << std::endl;
+      return 1;
+    }
+  }
+  if (format && !snapshot.empty() && fs->format() == -1) {
+    std::cout << "Could not format diskFile" << std::endl;
+    delete fs;
+    return 1;
+  }
   int option;
   std::string filename, content, newName;
     
@@ -28,7 +100,13 @@ int main() {
       case 1: // Crear archivo
         std::cout << "Nombre del archivo: ";
         std::getline(std::cin, filename);
-        fs->create(filename);
+        //  create avisa con una excepcion si el nombre ya existe o no hay
+        //  inodos; sin atraparla el programa terminaria sin el sync final
+        try {
+          fs->create(filename);
+        } catch (const std::runtime_error&) {
+          std::cout << "No se pudo crear \"" << filename << "\"" << std::endl;
+        }
         break;
                 
       case 2: // Agregar contenido
@@ -65,6 +143,52 @@ int main() {
         std::getline(std::cin, newName);
         fs->changeName(filename, newName);
         break;
+
+      case 8: // Revisar checksums del disco
+        fs->scrub();
+        break;
+
+      case 9: // Agregar contenido comprimido
+        std::cout << "Nombre del archivo: ";
+        std::getline(std::cin, filename);
+        std::cout << "Contenido: ";
+        std::getline(std::cin, content);
+        fs->add(filename, content, true);
+        break;
+
+      case 10: // Agregar contenido con dedup
+        std::cout << "Nombre del archivo: ";
+        std::getline(std::cin, filename);
+        std::cout << "Contenido: ";
+        std::getline(std::cin, content);
+        fs->add(filename, content, false, true);
+        break;
+
+      case 11: // Clonar archivo
+        std::cout << "Nombre del archivo: ";
+        std::getline(std::cin, filename);
+        std::cout << "Nombre del clon: ";
+        std::getline(std::cin, newName);
+        fs->clone(filename, newName);
+        break;
+
+      case 12: // Crear snapshot
+        std::cout << "Nombre del snapshot: ";
+        std::getline(std::cin, newName);
+        fs->snapshot(newName);
+        break;
+
+      case 13: // Listar snapshots
+        for (const std::string& name : fs->snapshots()) {
+          std::cout << name << std::endl;
+        }
+        break;
+
+      case 14: // Eliminar snapshot
+        std::cout << "Nombre del snapshot: ";
+        std::getline(std::cin, newName);
+        fs->deleteSnapshot(newName);
+        break;
                 
       case 0: // Salir
         std::cout << "¡Hasta luego!\n";
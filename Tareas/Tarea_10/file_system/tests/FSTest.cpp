@@ -0,0 +1,497 @@
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+#include "../include/FS.h"
+#include "../include/Lz.h"
+#include "../include/Murmur3.h"
+#include "../include/Crc32c.h"
+#include "../include/MemoryDisk.h"
+#include "../include/StripedDisk.h"
+
+//  pruebas de make test: cada caso corre sobre discos en memoria, asi que no
+//  toca diskFile.bin. Lo que FS imprime se descarta; solo se muestra el
+//  resultado de cada caso y las condiciones que fallaron
+
+static int failures = 0;
+
+#define CHECK(condition) check((condition), #condition, __LINE__)
+
+static void check(bool ok, const char* condition, int line) {
+  if (!ok) {
+    std::cerr << "  linea " << line << ": " << condition << std::endl;
+    failures++;
+  }
+}
+
+//  disco sobre otro que no es suyo, asi la imagen sobrevive al FS que la usa y
+//  se puede montar de nuevo. Despues del sync numero crashAfter deja de
+//  escribir, como si la maquina se hubiera apagado ahi; con -1 nunca
+class CrashDisk : public VDisk {
+ public:
+  CrashDisk(VDisk* image, int crashAfter = -1) : image(image), crashAfter(crashAfter) {
+    this->diskSize = image->size();
+  }
+
+  int read(size_t offset, void* buffer, size_t size) {
+    return this->image->read(offset, buffer, size);
+  }
+
+  int write(size_t offset, const void* buffer, size_t size) {
+    return this->crashed ? 0 : this->image->write(offset, buffer, size);
+  }
+
+  int sync() {
+    this->syncs++;
+    this->crashed = this->crashed || this->syncs == this->crashAfter;
+    return 0;
+  }
+
+  //  una operacion que retorna con syncs <= crashAfter ya era durable
+  bool durable() const {
+    return this->crashAfter == -1 || this->syncs <= this->crashAfter;
+  }
+
+  bool crashed = false;
+  int syncs = 0;
+
+ private:
+  VDisk* image;
+  int crashAfter;
+};
+
+//  acceso al estado interno de FS que las pruebas revisan
+struct FSTest {
+  static int freeBlocks(FS& fs) {
+    return fs.sb.freeBlocks;
+  }
+
+  //  ningun bloque con mas de un dueno
+  static bool unshared(FS& fs) {
+    return std::all_of(fs.refCounts.begin(), fs.refCounts.end(), [](uint32_t count) { return count == 0; });
+  }
+
+  //  el bitmap y el superBlock cuentan los mismos bloques ocupados
+  static bool bitMapMatches(FS& fs) {
+    fs.loadBitMap();
+    int used = 0;
+    for (int b = 0; b < fs.sb.TotalBlocks; b++) {
+      used += fs.bitMap.test(b);
+    }
+    return used == fs.sb.TotalBlocks - fs.sb.freeBlocks;
+  }
+
+  //  bloque fisico del bloque logico de un archivo
+  static int blockOf(FS& fs, const std::string& name, int logical) {
+    return fs.mapBlock(fs.searchInode(name), logical);
+  }
+
+  static std::vector<std::string> names(FS& fs) {
+    std::vector<std::string> listed;
+    fs.dirForEach(fs.sb.dirRoot, [](void* context, const dirEntry& entry) {
+      static_cast<std::vector<std::string>*>(context)->push_back(entry.name);
+    }, &listed);
+    return listed;
+  }
+
+  //  revisar el arbol B del directorio: cada nodo salvo la raiz con entre
+  //  t - 1 y 2t - 1 entradas ordenadas, todas las hojas a la misma altura y
+  //  en orden exactamente los nombres de expected
+  static bool directoryValid(FS& fs, const std::set<std::string>& expected) {
+    int leafDepth = -1;
+    bool ok = checkNode(fs, fs.sb.dirRoot, 0, true, leafDepth);
+    std::vector<std::string> listed = names(fs);
+    return ok && listed == std::vector<std::string>(expected.begin(), expected.end()) &&
+           (int)listed.size() == fs.sb.usedInodes;
+  }
+
+ private:
+  static bool checkNode(FS& fs, int block, int depth, bool root, int& leafDepth) {
+    const int t = (DIR_MAX_KEYS + 1) / 2;
+    dirNode node;
+    if (fs.readDirNode(block, node) == -1 || node.count > DIR_MAX_KEYS || (!root && node.count < t - 1)) {
+      return false;
+    }
+    for (int i = 1; i < node.count; i++) {
+      if (strncmp(node.entries[i - 1].name, node.entries[i].name, MAX_NAME_LENGTH) >= 0) {
+        return false;
+      }
+    }
+    if (node.leaf) {
+      if (leafDepth == -1) {
+        leafDepth = depth;
+      }
+      return leafDepth == depth;
+    }
+    for (int i = 0; i <= node.count; i++) {
+      if (!checkNode(fs, node.children[i], depth + 1, false, leafDepth)) {
+        return false;
+      }
+    }
+    return true;
+  }
+};
+
+static std::vector<char> randomBytes(size_t size, unsigned seed) {
+  std::mt19937 rng(seed);
+  std::vector<char> bytes(size);
+  for (char& c : bytes) {
+    c = (char)rng();
+  }
+  return bytes;
+}
+
+static std::string contentOf(FS& fs, const std::string& name) {
+  std::stringstream out;
+  return fs.read(name, 0, 1 << 24, out) == -1 ? "<sin archivo>" : out.str();
+}
+
+static void testLz() {
+  std::string text;
+  for (int i = 0; i < 400; i++) {
+    text += "bloque " + std::to_string(i % 37) + " del sistema de archivos; ";
+  }
+  std::vector<char> random = randomBytes(4096, 7);
+  std::vector<std::vector<char>> inputs = {
+    std::vector<char>(text.begin(), text.end()),
+    std::vector<char>(10000, 'a'),
+    random,
+    std::vector<char>(text.begin(), text.begin() + 5),
+  };
+  for (const std::vector<char>& input : inputs) {
+    std::vector<char> packed(input.size() * 2 + 16);
+    long n = Lz::compress(input.data(), input.size(), packed.data(), packed.size());
+    CHECK(n > 0);
+    std::vector<char> output(input.size());
+    CHECK(Lz::decompress(packed.data(), n, output.data(), output.size()) == (long)input.size());
+    CHECK(output == input);
+    //  sin lugar para el resultado no escribe de mas
+    if (input.size() > 1) {
+      CHECK(Lz::decompress(packed.data(), n, output.data(), input.size() - 1) == -1);
+    }
+  }
+  //  lo que no se achica no entra en menos espacio que el original
+  std::vector<char> small(random.size() - 1);
+  CHECK(Lz::compress(random.data(), random.size(), small.data(), small.size()) == -1);
+
+  //  entradas danadas: copia que apunta antes del inicio, literales que pasan
+  //  el final y largo extendido sin terminar
+  std::vector<char> output(64);
+  const char before[] = {0x10, 'x', 0x05, 0x00};
+  const char pastEnd[] = {(char)0x50, 'a', 'b'};
+  const char openLength[] = {(char)0xF0, (char)0xFF};
+  CHECK(Lz::decompress(before, sizeof(before), output.data(), output.size()) == -1);
+  CHECK(Lz::decompress(pastEnd, sizeof(pastEnd), output.data(), output.size()) == -1);
+  CHECK(Lz::decompress(openLength, sizeof(openLength), output.data(), output.size()) == -1);
+
+  //  bytes cambiados al azar nunca producen mas que capacity
+  std::vector<char> packed(text.size() * 2);
+  long n = Lz::compress(text.data(), text.size(), packed.data(), packed.size());
+  std::mt19937 rng(11);
+  for (int round = 0; round < 2000; round++) {
+    std::vector<char> damaged(packed.begin(), packed.begin() + n);
+    for (int k = 0; k < 3; k++) {
+      damaged[rng() % damaged.size()] = (char)rng();
+    }
+    std::vector<char> out(text.size());
+    long produced = Lz::decompress(damaged.data(), damaged.size(), out.data(), out.size());
+    CHECK(produced >= -1 && produced <= (long)out.size());
+  }
+}
+
+static void testHashes() {
+  const std::string empty;
+  const std::string hello = "hello";
+  const std::string fox = "The quick brown fox jumps over the lazy dog";
+  CHECK(Murmur3::compute(empty.data(), empty.size()) == (hash128{0, 0}));
+  CHECK(Murmur3::compute(hello.data(), hello.size()) == (hash128{0xcbd8a7b341bd9b02ULL, 0x5b1e906a48ae1d19ULL}));
+  CHECK(Murmur3::compute(fox.data(), fox.size()) == (hash128{0xe34bbc7bbc071b6cULL, 0x7a433ca9c49a9347ULL}));
+
+  //  vectores de RFC 3720 y el "123456789" de siempre, tambien encadenado
+  std::vector<char> zeros(32, 0);
+  std::vector<char> ones(32, (char)0xFF);
+  const std::string digits = "123456789";
+  CHECK(Crc32c::compute(digits.data(), digits.size()) == 0xE3069283u);
+  CHECK(Crc32c::compute(zeros.data(), zeros.size()) == 0x8A9136AAu);
+  CHECK(Crc32c::compute(ones.data(), ones.size()) == 0x62A8AB43u);
+  CHECK(Crc32c::compute(digits.data() + 4, 5, Crc32c::compute(digits.data(), 4)) == 0xE3069283u);
+}
+
+static void testDirectory() {
+  MemoryDisk image((size_t)TOTAL_BLOCKS * BLOCK_SIZE);
+  std::set<std::string> expected;
+  std::vector<std::string> order;
+  for (int i = 0; i < 120; i++) {
+    order.push_back("archivo" + std::to_string(i));
+  }
+  std::mt19937 rng(3);
+  std::shuffle(order.begin(), order.end(), rng);
+  {
+    FS fs(new CrashDisk(&image), true);
+    int free = FSTest::freeBlocks(fs);
+    //  con DIR_MAX_KEYS 5 esto parte nodos en varios niveles
+    for (const std::string& name : order) {
+      CHECK(fs.create(name) != -1);
+      expected.insert(name);
+    }
+    CHECK(FSTest::directoryValid(fs, expected));
+    CHECK(FSTest::freeBlocks(fs) < free);
+
+    //  borrar en otro orden junta y redistribuye nodos hasta dejar la raiz
+    std::shuffle(order.begin(), order.end(), rng);
+    for (size_t i = 0; i < 60; i++) {
+      CHECK(fs.deleteFile(order[i]) == 0);
+      expected.erase(order[i]);
+      if (i % 5 == 0) {
+        CHECK(FSTest::directoryValid(fs, expected));
+      }
+    }
+  }
+  //  lo que queda sigue ahi al montar de nuevo
+  FS fs(new CrashDisk(&image));
+  CHECK(FSTest::directoryValid(fs, expected));
+  for (const std::string& name : std::set<std::string>(expected)) {
+    CHECK(fs.deleteFile(name) == 0);
+    expected.erase(name);
+  }
+  CHECK(FSTest::directoryValid(fs, expected));
+  CHECK(FSTest::bitMapMatches(fs));
+}
+
+static void testJournalReplay() {
+  //  el apagon cae despues de cada uno de los primeros syncs, tambien justo
+  //  despues del sync del journal y antes de escribir en su lugar: todo lo
+  //  que ya era durable esta al montar, lo demas no existe o esta entero
+  for (int crashAfter = 1; crashAfter <= 40; crashAfter++) {
+    MemoryDisk image((size_t)TOTAL_BLOCKS * BLOCK_SIZE);
+    { FS fs(new CrashDisk(&image), true); }
+    std::set<std::string> added;
+    std::set<std::string> deleting;
+    std::set<std::string> deleted;
+    {
+      CrashDisk* disk = new CrashDisk(&image, crashAfter);
+      FS fs(disk);
+      for (int i = 0; i < 12 && disk->durable(); i++) {
+        std::string name = "f" + std::to_string(i);
+        fs.create(name);
+        fs.add(name, std::string(100 + i * 700, 'a' + i));
+        if (disk->durable()) {
+          added.insert(name);
+        }
+        //  f1, f5 y f9 se borran dos archivos despues
+        if (i % 4 == 3) {
+          std::string old = "f" + std::to_string(i - 2);
+          deleting.insert(old);
+          fs.deleteFile(old);
+          if (disk->durable()) {
+            deleted.insert(old);
+          }
+        }
+      }
+    }
+
+    FS fs(new CrashDisk(&image));
+    CHECK(FSTest::bitMapMatches(fs));
+    std::vector<std::string> listed = FSTest::names(fs);
+    for (const std::string& name : added) {
+      CHECK(deleting.count(name) || std::find(listed.begin(), listed.end(), name) != listed.end());
+    }
+    for (const std::string& name : listed) {
+      int i = std::stoi(name.substr(1));
+      std::string content = contentOf(fs, name);
+      CHECK(!deleted.count(name));
+      CHECK(content.empty() || content == std::string(100 + i * 700, 'a' + i));
+    }
+    CHECK(fs.scrub() == 0);
+  }
+}
+
+static void testOverwrites() {
+  //  un archivo escrito en un montaje anterior: la primera reescritura mueve
+  //  el bloque y la marca de su tramo va en la misma transaccion, sin un
+  //  sync propio; con la marca ya durable la siguiente escribe en su lugar
+  MemoryDisk image((size_t)TOTAL_BLOCKS * BLOCK_SIZE);
+  {
+    FS fs(new CrashDisk(&image), true);
+    fs.create("a");
+    fs.add("a", std::string(8 * BLOCK_SIZE, 'a'));
+  }
+  {
+    CrashDisk* disk = new CrashDisk(&image);
+    FS fs(disk);
+    //  el primer commit del montaje reinicia el journal con un sync aparte
+    fs.create("z");
+    std::string b(100, 'b');
+    int before = FSTest::blockOf(fs, "a", 2);
+    int syncs = disk->syncs;
+    CHECK(fs.write("a", 2 * BLOCK_SIZE + 10, b) == (long)b.size());
+    CHECK(disk->syncs - syncs == 1);
+    int moved = FSTest::blockOf(fs, "a", 2);
+    CHECK(moved != before);
+    syncs = disk->syncs;
+    CHECK(fs.write("a", 2 * BLOCK_SIZE + 500, b) == (long)b.size());
+    CHECK(disk->syncs - syncs == 1);
+    CHECK(FSTest::blockOf(fs, "a", 2) == moved);
+  }
+
+  //  con un apagon en cada sync, cada byte queda viejo o nuevo y todos los
+  //  bloques coinciden con sus checksums
+  for (int crashAfter = 1; crashAfter <= 6; crashAfter++) {
+    MemoryDisk copy((size_t)TOTAL_BLOCKS * BLOCK_SIZE);
+    std::vector<char> whole(image.size());
+    image.read(0, whole.data(), whole.size());
+    copy.write(0, whole.data(), whole.size());
+    {
+      FS fs(new CrashDisk(&copy, crashAfter));
+      for (int i = 0; i < 4; i++) {
+        fs.write("a", i * BLOCK_SIZE + 300, std::string(BLOCK_SIZE, 'c' + i));
+      }
+    }
+    FS fs(new CrashDisk(&copy));
+    std::string content = contentOf(fs, "a");
+    CHECK(content.size() == 8 * BLOCK_SIZE);
+    CHECK(content.find_first_not_of("abcdef") == std::string::npos);
+    CHECK(fs.scrub() == 0);
+  }
+}
+
+static void testReplace() {
+  //  con lugar para las dos copias un add que falla deja el contenido
+  //  anterior; sin lugar para las dos, lo reemplaza en su lugar
+  MemoryDisk image((size_t)TOTAL_BLOCKS * BLOCK_SIZE);
+  FS fs(new CrashDisk(&image), true);
+  std::string old(20 * BLOCK_SIZE, 'a');
+  fs.create("a");
+  CHECK(fs.add("a", old) == 0);
+  fs.create("relleno");
+  CHECK(fs.add("relleno", std::string((size_t)(FSTest::freeBlocks(fs) - 30) * BLOCK_SIZE, 'r')) == 0);
+  int free = FSTest::freeBlocks(fs);
+  CHECK(free >= 20 && free < 40);
+
+  CHECK(fs.add("a", std::string((size_t)(free + 25) * BLOCK_SIZE, 'x')) == -1);
+  CHECK(contentOf(fs, "a") == old);
+  CHECK(FSTest::freeBlocks(fs) == free);
+
+  std::string replacement((size_t)(free + 10) * BLOCK_SIZE, 'b');
+  CHECK(fs.add("a", replacement) == 0);
+  CHECK(contentOf(fs, "a") == replacement);
+  CHECK(FSTest::freeBlocks(fs) == 10);  //  vuelven los 20 del contenido anterior
+  CHECK(FSTest::bitMapMatches(fs));
+}
+
+static void testStriping() {
+  const size_t stripe = 2 * BLOCK_SIZE;
+  for (size_t n : {1, 3}) {
+    std::vector<MemoryDisk*> disks;
+    std::vector<VDisk*> images;
+    for (size_t d = 0; d < n; d++) {
+      //  un disco mas chico manda: cada uno aporta sus franjas enteras comunes
+      disks.push_back(new MemoryDisk(d == 0 ? 10 * stripe + 100 : 12 * stripe));
+      images.push_back(disks.back());
+    }
+    StripedDisk striped(images, stripe);
+    CHECK(striped.size() == 10 * stripe * n);
+
+    //  una escritura que cruza varias franjas cae en disk s % N, en (s / N) * franja
+    size_t offset = stripe / 2 + 7;
+    std::vector<char> data = randomBytes(5 * stripe, 5);
+    CHECK(striped.write(offset, data.data(), data.size()) == 0);
+    bool mapped = true;
+    for (size_t i = 0; i < data.size(); i += 97) {
+      size_t position = offset + i;
+      size_t s = position / stripe;
+      char byte;
+      disks[s % n]->read((s / n) * stripe + position % stripe, &byte, 1);
+      mapped = mapped && byte == data[i];
+    }
+    CHECK(mapped);
+
+    std::vector<char> back(data.size());
+    CHECK(striped.read(offset, back.data(), back.size()) == 0);
+    CHECK(back == data);
+
+    //  lo mismo por lotes, con una lectura que empieza a mitad de franja
+    std::vector<char> other = randomBytes(3 * stripe, 9);
+    std::vector<diskWrite> writes = {{stripe * 4, other.data(), stripe}, {stripe * 6 + 3, other.data() + stripe, 2 * stripe}};
+    CHECK(striped.writeBatch(writes) == 0);
+    std::vector<char> first(stripe);
+    std::vector<char> second(2 * stripe);
+    std::vector<diskRead> reads = {{stripe * 4, first.data(), stripe}, {stripe * 6 + 3, second.data(), 2 * stripe}};
+    CHECK(striped.readBatch(reads) == 0);
+    CHECK(std::equal(first.begin(), first.end(), other.begin()));
+    CHECK(std::equal(second.begin(), second.end(), other.begin() + stripe));
+    CHECK(striped.read(striped.size() - 1, back.data(), 2) == -1);
+  }
+}
+
+static void testSharing() {
+  MemoryDisk image((size_t)TOTAL_BLOCKS * BLOCK_SIZE);
+  {
+    FS fs(new CrashDisk(&image), true);
+    int free = FSTest::freeBlocks(fs);
+    std::vector<char> data = randomBytes(40 * BLOCK_SIZE, 13);
+    std::string content(data.begin(), data.end());
+    CHECK(fs.create("original") != -1);
+    CHECK(fs.add("original", content) == 0);
+    int afterAdd = FSTest::freeBlocks(fs);
+
+    //  el clon no ocupa bloques de datos hasta que se escribe
+    CHECK(fs.clone("original", "clon") == 0);
+    CHECK(FSTest::freeBlocks(fs) >= afterAdd - INDIRECT_BLOCK_SIZE);
+    CHECK(!FSTest::unshared(fs));
+    std::string patch(3 * BLOCK_SIZE, 'p');
+    CHECK(fs.write("clon", BLOCK_SIZE / 2, std::span<const char>(patch.data(), patch.size())) == (long)patch.size());
+    CHECK(contentOf(fs, "original") == content);
+
+    CHECK(fs.snapshot("s") == 0);
+    CHECK(fs.write("original", 10 * BLOCK_SIZE, std::span<const char>(patch.data(), patch.size())) == (long)patch.size());
+    std::string changed = content;
+    changed.replace(10 * BLOCK_SIZE, patch.size(), patch);
+    CHECK(contentOf(fs, "original") == changed);
+
+    CHECK(fs.deleteFile("clon") == 0);
+    CHECK(fs.deleteSnapshot("s") == 0);
+    CHECK(fs.deleteFile("original") == 0);
+    CHECK(FSTest::unshared(fs));
+    CHECK(FSTest::freeBlocks(fs) == free);
+    CHECK(FSTest::bitMapMatches(fs));
+    CHECK(fs.scrub() == 0);
+  }
+  //  las cuentas que quedaron en la imagen tambien estan en cero
+  FS fs(new CrashDisk(&image));
+  CHECK(FSTest::unshared(fs));
+  CHECK(FSTest::bitMapMatches(fs));
+}
+
+int main() {
+  typedef struct testCase {
+    const char* name;
+    void (*run)();
+  } testCase;
+  const testCase cases[] = {
+    {"lz", testLz},
+    {"murmur3 y crc32c", testHashes},
+    {"arbol B del directorio", testDirectory},
+    {"journal despues de un apagon", testJournalReplay},
+    {"reescrituras en su lugar", testOverwrites},
+    {"add sin lugar para dos copias", testReplace},
+    {"franjas de StripedDisk", testStriping},
+    {"clones y snapshots", testSharing},
+  };
+
+  std::stringstream discarded;
+  std::streambuf* console = std::cout.rdbuf();
+  for (const testCase& test : cases) {
+    int before = failures;
+    std::cout.rdbuf(discarded.rdbuf());
+    test.run();
+    std::cout.rdbuf(console);
+    discarded.str("");
+    std::cout << (failures == before ? "ok     " : "FALLA  ") << test.name << std::endl;
+  }
+  return failures == 0 ? 0 : 1;
+}